@@ -28,6 +28,11 @@
  * - changing receive to use DMA
  * - Added enums
  * - updated some spelling
+ * - receiving into a circular DMA ring with a streaming UBX parser
+ * - queued, non-blocking requests with completion callbacks
+ * - periodic NAV-PVT output instead of polling
+ * - baud rate negotiation with fallback
+ * - position and time only in the compact fix
  ******************************************************************************
  */
 
@@ -36,29 +41,34 @@
 
 #include "main.h"
 
-union u_Short
-{
-	uint8_t bytes[2];
-	unsigned short uShort;
-};
+/* circular DMA receive ring, the parser runs at half, full and idle line */
+#define GNSS_RX_RING		64
 
-union i_Short
-{
-	uint8_t bytes[2];
-	signed short iShort;
-};
+/* largest UBX frame kept by the parser (NAV-PVT), longer ones are skipped */
+#define GNSS_FRAME_MAX		100
 
-union u_Long
-{
-	uint8_t bytes[4];
-	unsigned long uLong;
-};
+/* longest payload skipped (NAV-SAT with 64 satellites is 776 bytes), a
+ * longer length is taken for a false sync in noise and resynchronizes */
+#define GNSS_SKIP_MAX		1024
 
-union i_Long
-{
-	uint8_t bytes[4];
-	signed long iLong;
-};
+/* how long a request waits for its answer or acknowledge */
+#define GNSS_TIMEOUT_MS		1200
+
+/* navigation (and NAV-PVT output) period set by GNSS_LoadConfig */
+#define GNSS_NAV_RATE_MS	1000
+
+/* GPS link rates, the receiver starts at GNSS_BAUD_DEFAULT */
+#define GNSS_BAUD_DEFAULT	9600
+#define GNSS_BAUD_FAST		115200
+
+/* requests waiting for the receiver, including the one in progress */
+#define GNSS_QUEUE_LEN		6
+
+/* request results, passed to the done callback */
+#define GNSS_OK				0
+#define GNSS_ERR_TIMEOUT	1
+#define GNSS_ERR_NAK		2
+#define GNSS_ERR_BUSY		3
 
 enum GNSSMode {
 	ModePortable	= 0,
@@ -83,43 +93,87 @@ enum GNSSFixType {
 	FixNotSet       = -1
 };
 
+/*
+ * compact fix snapshot
+ * raw UBX-NAV-PVT units, published as a whole by the parser (see GNSS_GetFix)
+ */
 typedef struct {
-	UART_HandleTypeDef *huart;
-
-	uint8_t uniqueID[5];
-	uint8_t uartWorkingBuffer[101];
-
-	unsigned short year;
-	uint8_t yearBytes[2];
+	int32_t lon;		/* 1e-7 deg */
+	int32_t lat;		/* 1e-7 deg */
+	int32_t hMSL;		/* mm */
+	int32_t gSpeed;		/* mm/s */
+	int32_t headMot;	/* 1e-5 deg */
+	uint16_t year;
 	uint8_t month;
 	uint8_t day;
 	uint8_t hour;
 	uint8_t min;
 	uint8_t sec;
-	enum GNSSFixType fixType;
+	uint8_t fixType;
 	uint8_t numSV;
+} GNSS_Fix;
 
-	signed long lon;
-	uint8_t lonBytes[4];
-	signed long lat;
-	uint8_t latBytes[4];
-	float fLon;
-	float fLat;
-
-	signed long height;
-	signed long hMSL;
-	uint8_t hMSLBytes[4];
-	unsigned long hAcc;
-	unsigned long vAcc;
+struct GNSS_StateHandle;
 
-	signed long gSpeed;
-	uint8_t gSpeedBytes[4];
-	signed long headMot;
+/*
+ * queued request: a complete UBX frame, answered by the same class/ID
+ * (polls) or by an ACK-ACK/ACK-NAK (CFG). done is called from interrupt
+ * context with the result and may queue the next request.
+ */
+typedef struct {
+	const uint8_t *msg;
+	uint16_t len;
+	/* if not 0, USART2 switches to this rate once the request is done */
+	uint32_t baud;
+	void (*done)(struct GNSS_StateHandle *GNSS, uint8_t status);
+} GNSS_Request;
+
+typedef struct GNSS_StateHandle {
+	UART_HandleTypeDef *huart;
 
-	uint8_t *txDone;
-	uint8_t *rxDone;
+	uint8_t uniqueID[5];
+	/* frame being assembled by the parser, sync characters included */
+	uint8_t uartWorkingBuffer[GNSS_FRAME_MAX];
+
+	/* receive ring, position of the next byte to parse */
+	uint8_t rxRing[GNSS_RX_RING];
+	uint16_t rxPos;
+
+	/* UBX parser */
+	uint8_t rxState;
+	uint8_t rxCkA;
+	uint8_t rxCkB;
+	uint16_t rxLen;
+	uint16_t rxIdx;
+	/* class and ID of the outstanding request, 0 if none */
+	uint16_t rxExpect;
+
+	/* request queue, the head is the request in progress */
+	GNSS_Request queue[GNSS_QUEUE_LEN];
+	uint8_t qHead;
+	uint8_t qCount;
+	uint32_t reqStart;
+	uint32_t reqCycles;
+
+	/* rate switch waiting for the parser to leave the ring, 0 if none */
+	uint32_t pendingBaud;
+	/* current link rate, round trip of the last answered request */
+	uint32_t baud;
+	uint32_t latencyUs;
+	/* NAV-PVT poll round trip at GNSS_BAUD_DEFAULT and GNSS_BAUD_FAST, 0 if not answered */
+	uint32_t pvtLatencyUs[2];
+	/* configuration step that found the queue full, GNSS_Tick runs it again */
+	void (*retry)(struct GNSS_StateHandle *GNSS);
+	/* frames dropped for a bad checksum */
+	uint16_t rxErrors;
 
 	enum GNSSMode selectedMode;
+	/* NAV-PVT is pushed every navigation solution, no polling needed */
+	volatile uint8_t pvtPeriodic;
+
+	/* seqlock: odd while the parser is writing fix */
+	volatile uint32_t fixSeq;
+	GNSS_Fix fix;
 
 } GNSS_StateHandle;
 
@@ -142,6 +196,12 @@ static const uint8_t getPOSLLHData[]={0xB5,0x62,0x01,0x02,0x00,0x00,0x03,0x0A};
 
 static const uint8_t getPVTData[]={0xB5,0x62,0x01,0x07,0x00,0x00,0x08,0x19};
 
+//NAV-PVT output on the current port with every navigation solution
+static const uint8_t setPVTPeriodic[]={0xB5,0x62,0x06,0x01,0x03,0x00,0x01,0x07,0x01,0x13,0x51};
+
+//NAV-PVT output off, left on when only the MCU was reset
+static const uint8_t setPVTOff[]={0xB5,0x62,0x06,0x01,0x03,0x00,0x01,0x07,0x00,0x12,0x50};
+
 static const uint8_t setPortableMode[]={0xB5,0x62,0x06,0x24,0x24,0x00,0xFF,0xFF,0x00,0x03,0x00,0x00,0x00,0x00,0x10,0x27,0x00,0x00,0x05,0x00,0xFA,0x00,0xFA,0x00,0x64,0x00,0x5E,0x01,0x00,0x3C,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x7E,0x3C};
 
 static const uint8_t setStationaryMode[]={0xB5,0x62,0x06,0x24,0x24,0x00,0xFF,0xFF,0x02,0x03,0x00,0x00,0x00,0x00,0x10,0x27,0x00,0x00,0x05,0x00,0xFA,0x00,0xFA,0x00,0x64,0x00,0x5E,0x01,0x00,0x3C,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x80,0x80};
@@ -160,23 +220,29 @@ static const uint8_t setWristMode[]={0xB5,0x62,0x06,0x24,0x24,0x00,0xFF,0xFF,0x0
 
 static const uint8_t setBikeMode[]={0xB5,0x62,0x06,0x24,0x24,0x00,0xFF,0xFF,0x0A,0x03,0x00,0x00,0x00,0x00,0x10,0x27,0x00,0x00,0x05,0x00,0xFA,0x00,0xFA,0x00,0x64,0x00,0x5E,0x01,0x00,0x3C,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x88,0x90};
 
-void GNSS_Init(GNSS_StateHandle *GNSS, UART_HandleTypeDef *huart, uint8_t *txDone, uint8_t *rxDone);
+void GNSS_Init(GNSS_StateHandle *GNSS, UART_HandleTypeDef *huart);
+void GNSS_StartRx(GNSS_StateHandle *GNSS);
 void GNSS_LoadConfig(GNSS_StateHandle *GNSS);
-void GNSS_ParseBuffer(GNSS_StateHandle *GNSS);
+void GNSS_ParseBuffer(GNSS_StateHandle *GNSS, uint16_t head);
+void GNSS_GetFix(GNSS_StateHandle *GNSS, GNSS_Fix *fix);
+
+uint8_t GNSS_Submit(GNSS_StateHandle *GNSS, const uint8_t *msg, uint16_t len,
+		void (*done)(GNSS_StateHandle *GNSS, uint8_t status));
+void GNSS_Tick(GNSS_StateHandle *GNSS);
 
-void GNSS_GetUniqID(GNSS_StateHandle *GNSS);
-void GNSS_ParseUniqID(GNSS_StateHandle *GNSS);
+uint8_t GNSS_GetUniqID(GNSS_StateHandle *GNSS, void (*done)(GNSS_StateHandle *GNSS, uint8_t status));
+void GNSS_ParseUniqID(GNSS_StateHandle *GNSS, const uint8_t *payload);
 
-void GNSS_GetNavigatorData(GNSS_StateHandle *GNSS);
-void GNSS_ParseNavigatorData(GNSS_StateHandle *GNSS);
+uint8_t GNSS_GetNavigatorData(GNSS_StateHandle *GNSS, void (*done)(GNSS_StateHandle *GNSS, uint8_t status));
+void GNSS_ParseNavigatorData(GNSS_StateHandle *GNSS, const uint8_t *payload);
 
-void GNSS_GetPOSLLHData(GNSS_StateHandle *GNSS);
-void GNSS_ParsePOSLLHData(GNSS_StateHandle *GNSS);
+uint8_t GNSS_GetPOSLLHData(GNSS_StateHandle *GNSS, void (*done)(GNSS_StateHandle *GNSS, uint8_t status));
+void GNSS_ParsePOSLLHData(GNSS_StateHandle *GNSS, const uint8_t *payload);
 
-void GNSS_GetPVTData(GNSS_StateHandle *GNSS);
-void GNSS_ParsePVTData(GNSS_StateHandle *GNSS);
+uint8_t GNSS_GetPVTData(GNSS_StateHandle *GNSS, void (*done)(GNSS_StateHandle *GNSS, uint8_t status));
+void GNSS_ParsePVTData(GNSS_StateHandle *GNSS, const uint8_t *payload);
 
-void GNSS_SetMode(GNSS_StateHandle *GNSS, short gnssMode);
+uint8_t GNSS_SetMode(GNSS_StateHandle *GNSS, short gnssMode);
 #endif /* INC_GNSS_H_ */
 
 
@@ -0,0 +1,95 @@
+/**
+  ******************************************************************************
+  * @file    afsk.h
+  * @brief   This file contains all the function prototypes for
+  *          the afsk.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  */
+
+#ifndef INC_AFSK_H_
+#define INC_AFSK_H_
+
+#include "main.h"
+#include "aprs.h"
+#include "si4063.h"
+
+/*
+ * DMA waveform buffer
+ * two halves of AFSK_DMA_HALF_LEN samples (~4 baud periods at 26.3 kHz) each,
+ * one BSRR word per APRS sample tick. one half is refilled from the pre-encoded
+ * bitstream while the other one is played.
+ */
+#define AFSK_DMA_HALF_LEN	88
+#define AFSK_DMA_BUF_LEN	(2 * AFSK_DMA_HALF_LEN)
+
+/* BSRR words driving Si4063 GPIO3 (PA4) */
+#define AFSK_BSRR_HIGH		((uint32_t)oSpiGPIO3_Pin)
+#define AFSK_BSRR_LOW		((uint32_t)oSpiGPIO3_Pin << 16)
+
+/*
+ * sine AFSK
+ * the tone is generated inside the Si4063 by writing a sine table into
+ * MODEM_FREQ_OFFSET (FREQ_DEV = 0), i.e. FM of a sine instead of a square
+ * wave. one SET_PROPERTY per sample, so TIM15 runs at half the square wave
+ * sample rate (16 MHz / (304 * 4) = 13157.9 Hz, ~6 samples per space cycle)
+ * and SPI1 runs at AFSK_SINE_SPI_PRESCALER for the frame.
+ */
+#define AFSK_SINE_TICK_PERIOD	3
+#define AFSK_SINE_TICK_DIV		((APRS_TICK_PRESCALER + 1) * (AFSK_SINE_TICK_PERIOD + 1))
+#define AFSK_SINE_MARK_STEP		APRS_NCO_STEP_DIV(APRS_MARK_HZ, AFSK_SINE_TICK_DIV)
+#define AFSK_SINE_SPACE_STEP	APRS_NCO_STEP_DIV(APRS_SPACE_HZ, AFSK_SINE_TICK_DIV)
+#define AFSK_SINE_BAUD_STEP		APRS_NCO_STEP_DIV(APRS_BAUD, AFSK_SINE_TICK_DIV)
+#define AFSK_SINE_TABLE_BITS	6
+#define AFSK_SINE_TABLE_LEN		(1 << AFSK_SINE_TABLE_BITS)
+/* peak deviation in PLL offset steps, same as the 2FSK setup in si4060_set_aprs_params_TESTING */
+#define AFSK_SINE_DEV			((int32_t)(2 * FDEV_APRS_DFM))
+
+/*
+ * cycle budget of one sample
+ * SET_PROPERTY MODEM_FREQ_OFFSET is 6 bytes (cmd, group, count, index, 16 bit value).
+ * the overhead estimate covers interrupt entry, HAL_TIM_IRQHandler, the NCO
+ * and the per byte TXE/BSY polling in SpiWriteData. at least half of every
+ * sample period is left to the rest of the system. tx_aprs prints the
+ * measured afsk_sine_max_cycles against AFSK_SINE_WRITE_CYCLES.
+ */
+#define AFSK_SINE_SPI_PRESCALER		SPI_BAUDRATEPRESCALER_2
+#define AFSK_SINE_SPI_DIV			2
+#define AFSK_SINE_SPI_BYTES			6
+#define AFSK_SINE_OVERHEAD_CYCLES	400
+#define AFSK_SINE_WRITE_CYCLES		(AFSK_SINE_SPI_BYTES * 8 * AFSK_SINE_SPI_DIV + AFSK_SINE_OVERHEAD_CYCLES)
+#define AFSK_SINE_SAMPLE_CYCLES		AFSK_SINE_TICK_DIV
+
+_Static_assert(2 * AFSK_SINE_WRITE_CYCLES <= AFSK_SINE_SAMPLE_CYCLES,
+		"MODEM_FREQ_OFFSET update does not fit into the sine AFSK sample period");
+
+void afsk_dma_start(void);
+void afsk_dma_stop(void);
+uint8_t afsk_dma_busy(void);
+
+void afsk_sine_start(void);
+void afsk_sine_tick(void);
+void afsk_sine_finish(void);
+uint8_t afsk_sine_busy(void);
+uint16_t afsk_sine_overruns(void);
+uint32_t afsk_sine_max_cycles(void);
+
+#endif /* INC_AFSK_H_ */
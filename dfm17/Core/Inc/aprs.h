@@ -32,8 +32,21 @@
 
 #include <inttypes.h>
 #include "GNSS.h"
+#include "mice.h"
 
 void aprs_prepare_buffer(GNSS_StateHandle *GNSS, uint8_t backlog_fix);
+uint8_t aprs_prepare_mice(GNSS_StateHandle *GNSS);
+uint8_t aprs_set_header(const char *dst, uint8_t dst_ssid, const char *src, uint8_t src_ssid,
+		const char * const *path, const uint8_t *path_ssid, uint8_t path_count);
+void calculate_fcs(void);
+void aprs_encode_frame(void);
+uint8_t aprs_queue_frame(void);
+uint8_t aprs_queue_count(void);
+uint8_t aprs_encode_burst(void);
+uint32_t aprs_compress_lat(int32_t lat);
+uint32_t aprs_compress_lon(int32_t lon);
+uint16_t aprs_compress_alt(int32_t hmsl);
+int16_t aprs_loopback_check(void);
 void tx_aprs(void);
 
 
@@ -44,22 +57,73 @@ void tx_aprs(void);
 /* WIDE1-x SSID */
 #define WIDE_SSID	1
 
-/* data from matlab script */
+/*
+ * AFSK engine used by tx_aprs
+ * APRS_USE_DMA:  stream the pre-encoded frame to GPIO3 with TIM15 update DMA (see afsk.c)
+ * APRS_USE_SINE: write a sine table into MODEM_FREQ_OFFSET from the TIM15 interrupt (see afsk.c)
+ * otherwise:     toggle GPIO3 from the main loop on TIM15 tick interrupts
+ */
+//#define APRS_USE_DMA
+//#define APRS_USE_SINE
+
+/*
+ * decode aprs_stream again after encoding it at startup (see aprs_loopback_check)
+ * and report the encoder / decoder throughput over APRS_LOOPBACK_RUNS frames
+ */
+//#define APRS_LOOPBACK_CHECK
+#define APRS_LOOPBACK_RUNS	50
+
+#if defined(APRS_USE_DMA) && defined(APRS_USE_SINE)
+#error "APRS_USE_DMA and APRS_USE_SINE are mutually exclusive"
+#endif
+
 #define APRS_MARK		0
 #define APRS_SPACE		1
-#define APRS_MARK_TICKS		11
-#define APRS_SPACE_TICKS	6
-#define APRS_BAUD_TICKS		22
+
+/*
+ * APRS sample clock (TIM15 update rate)
+ * f_sample = APRS_TICK_CLK_HZ / ((APRS_TICK_PRESCALER + 1) * (APRS_TICK_PERIOD + 1))
+ * default: 16 MHz / (304 * 2) = 26315.8 Hz
+ */
+#define APRS_TICK_CLK_HZ	16000000ULL
+#define APRS_TICK_PRESCALER	303
+#define APRS_TICK_PERIOD	1
+#define APRS_TICK_DIV		((APRS_TICK_PRESCALER + 1) * (APRS_TICK_PERIOD + 1))
+
+/*
+ * phase continuous NCO
+ * 32 bit phase accumulators advanced once per sample tick. the tone output is
+ * the MSB of the tone phase, the bit clock ticks on every overflow of the baud
+ * phase. the frequency resolution is f_sample / 2^32 (~6 uHz), so tones and bit
+ * clock are exact for practical purposes and nothing drifts over a frame.
+ */
+#define APRS_MARK_HZ		1200
+#define APRS_SPACE_HZ		2200
+#define APRS_BAUD			1200
+#define APRS_NCO_STEP_DIV(f, div)	((uint32_t)((((uint64_t)(f) << 32) * (div)) / APRS_TICK_CLK_HZ))
+#define APRS_NCO_STEP(f)	APRS_NCO_STEP_DIV(f, APRS_TICK_DIV)
+#define APRS_MARK_STEP		APRS_NCO_STEP(APRS_MARK_HZ)
+#define APRS_SPACE_STEP		APRS_NCO_STEP(APRS_SPACE_HZ)
+#define APRS_BAUD_STEP		APRS_NCO_STEP(APRS_BAUD)
+#define APRS_NCO_MSB		0x80000000UL
 
 /* AX.25 header consists of:
- * 	7 bytes source
  * 	7 bytes destination
- * 	7 bytes path
- * 	7 bytes repeater subfield
+ * 	7 bytes source
+ * 	7 bytes per path entry (0 .. APRS_MAX_PATH)
  * 	1 byte control field
  * 	1 byte PID field
+ * it is built at runtime by aprs_set_header, the length is in aprs_header_len
  */
-#define APRS_HEADER_LEN	23
+#define APRS_ADDR_LEN		7
+#define APRS_CALL_LEN		6
+#define APRS_MAX_PATH		2
+#define APRS_HEADER_MAX_LEN	(APRS_ADDR_LEN * (2 + APRS_MAX_PATH) + 2)
+
+/* default header, used until aprs_set_header is called */
+#define APRS_DST_CALL	"APRS"
+#define APRS_SRC_CALL	"KE0PRY"
+#define APRS_PATH_CALL	"WIDE1"
 
 #define PID_NONE	0xf0
 #define CONTROL_UI	0x03
@@ -68,6 +132,17 @@ void tx_aprs(void);
 
 #define APRS_TLM_TEMP_OFFSET	512
 
+/*
+ * compressed position scale factors, integer only
+ * lat: 380926 / 1e7 per 1e-7 deg, lon: 190463 / 1e7 per 1e-7 deg (Q32)
+ * alt: 1 / log2(1.002) (Q16), log2(12500) (Q16), altitude clamped to 50 km
+ */
+#define APRS_LAT_SCALE_Q32		163606471UL
+#define APRS_LON_SCALE_Q32		81803236UL
+#define APRS_ALT_SCALE_Q16		22735752UL
+#define APRS_LOG2_12500_Q16		891921UL
+#define APRS_ALT_MAX_MM			50000000L
+
 /*
  * buffer length
  * example: /ddhhmmz/xxxxyyyyOaa1|ss001122|
@@ -97,17 +172,59 @@ void tx_aprs(void);
 #define APRS_ALT_START	18
 #define APRS_ALT_LEN	2
 #define APRS_SEQ_START	22
-#define APRS_SEQ_LEN	1
+#define APRS_SEQ_LEN	2
 #define APRS_TEMP_START	24
-#define APRS_TEMP_LEN	1
+#define APRS_TEMP_LEN	2
 #define APRS_VOLT_START	26
-#define APRS_VOLT_LEN	1
+#define APRS_VOLT_LEN	2
 #define APRS_VSOL_START	28
-#define APRS_VSOL_LEN	1
+#define APRS_VSOL_LEN	2
 
 #define AX25_SFLAGS	75
 #define AX25_EFLAGS	2
+/* flags between two frames of a burst */
+#define AX25_IFLAGS	2
 
 #define AX25_FLAG	0b01111110
 
+/*
+ * info field formats, selected per frame by the prepare function used last
+ * APRS_FMT_COMPRESSED: aprs_buf, see aprs_prepare_buffer
+ * APRS_FMT_MICE:       Mic-E, latitude in the destination address, see aprs_prepare_mice
+ */
+#define APRS_FMT_COMPRESSED	0
+#define APRS_FMT_MICE		1
+
+#define APRS_INFO_MAX_LEN	(APRS_BUF_LEN)
+
+/*
+ * one frame of a stream, info field and FCS. Mic-E frames carry their own
+ * destination address, all other header bytes come from aprs_header.
+ */
+typedef struct {
+	char info[APRS_INFO_MAX_LEN];
+	uint8_t info_len;
+	uint8_t own_dst;
+	unsigned char dst[APRS_ADDR_LEN];
+	uint16_t fcs;
+} APRS_Frame;
+
+/*
+ * frame queue
+ * frames stored with aprs_queue_frame and sent back to back after a single
+ * key-up (aprs_encode_burst + tx_aprs)
+ */
+#define APRS_QUEUE_LEN		4
+
+/*
+ * pre-encoded bitstream length
+ * all flags and up to APRS_QUEUE_LEN frames, plus one stuffed bit per five
+ * frame bits (worst case)
+ */
+#define APRS_FRAME_LEN		(APRS_HEADER_MAX_LEN + APRS_INFO_MAX_LEN + 2)
+#define APRS_FRAME_BITS		(8 * APRS_FRAME_LEN + (8 * APRS_FRAME_LEN) / 5)
+#define APRS_STREAM_BITS	(8 * (AX25_SFLAGS + AX25_EFLAGS + 1 + (APRS_QUEUE_LEN - 1) * AX25_IFLAGS) \
+								+ APRS_QUEUE_LEN * APRS_FRAME_BITS)
+#define APRS_STREAM_LEN		((APRS_STREAM_BITS + 7) / 8)
+
 #endif /* INC_APRS_H_ */
@@ -0,0 +1,43 @@
+/**
+  ******************************************************************************
+  * @file    ax25_decode.h
+  * @brief   This file contains all the function prototypes for
+  *          the ax25_decode.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  */
+
+#ifndef INC_AX25_DECODE_H_
+#define INC_AX25_DECODE_H_
+
+#include <inttypes.h>
+
+/* ax25_decode error codes */
+#define AX25_ERR_NOFRAME	-1	/* no closing flag after a frame */
+#define AX25_ERR_FCS		-2	/* frame check sequence mismatch */
+#define AX25_ERR_OVERFLOW	-3	/* frame does not fit into the output buffer */
+
+/* shortest frame accepted: control field and FCS */
+#define AX25_MIN_FRAME_LEN	3
+
+int16_t ax25_decode(const uint8_t *stream, uint16_t bits, uint8_t *frame, uint16_t max_len);
+
+#endif /* INC_AX25_DECODE_H_ */
@@ -0,0 +1,53 @@
+/**
+  ******************************************************************************
+  * @file    fcs.h
+  * @brief   This file contains all the function prototypes for
+  *          the fcs.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  */
+
+#ifndef INC_FCS_H_
+#define INC_FCS_H_
+
+#include <inttypes.h>
+
+/*
+ * select the lookup table used for the AX.25 FCS (CRC-16/X.25)
+ * - byte-wise:   256 entry table (512 bytes flash), one lookup per octet
+ * - nibble-wise:  16 entry table ( 32 bytes flash), two lookups per octet
+ */
+//#define FCS_USE_NIBBLE_TABLE
+
+/* CRC register preload value and final XOR value */
+#define FCS_INIT		0xFFFF
+#define FCS_XOROUT		0xFFFF
+/* register value after running over a frame including its (correct) FCS */
+#define FCS_RESIDUE		0xF0B8
+
+uint16_t fcs_update(uint16_t crc, const uint8_t *data, uint16_t len);
+#ifdef FCS_USE_NIBBLE_TABLE
+uint16_t fcs_update_nibblewise(uint16_t crc, const uint8_t *data, uint16_t len);
+#else
+uint16_t fcs_update_bytewise(uint16_t crc, const uint8_t *data, uint16_t len);
+#endif
+
+#endif /* INC_FCS_H_ */
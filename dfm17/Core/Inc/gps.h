@@ -34,8 +34,8 @@ void gpsUpdate(void);
 void assertGpsLock(void);
 void deassertGpsLock(void);
 
-void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t size);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
 
 uint8_t checkUbxCrc(uint8_t *packet, uint8_t size);
 uint8_t buildUbxPacket(uint8_t *packet, uint8_t *payload, uint8_t sizeOfPayload);
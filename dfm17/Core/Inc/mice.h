@@ -0,0 +1,57 @@
+/**
+  ******************************************************************************
+  * @file    mice.h
+  * @brief   This file contains all the function prototypes for
+  *          the mice.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  */
+
+#ifndef INC_MICE_H_
+#define INC_MICE_H_
+
+#include <inttypes.h>
+#include "GNSS.h"
+
+/*
+ * Mic-E position report
+ * latitude, N/S, longitude offset and W/E are carried in the 6 destination
+ * callsign characters, longitude, speed, course, symbol and altitude in the
+ * info field:
+ * 	1 data type (current GPS data)
+ * 	3 longitude degrees / minutes / hundredths
+ * 	3 speed / course
+ * 	2 symbol / symbol table
+ * 	4 altitude (base91, m + 10000) and '}'
+ */
+#define MICE_INFO_LEN		13
+#define MICE_DST_LEN		6
+
+#define MICE_DATA_CURRENT	'`'
+#define MICE_SYMBOL			'O'		/* balloon */
+#define MICE_SYMBOL_TABLE	'/'
+
+/* message bits A, B, C (standard message, 0b111 = M0 "Off Duty", 0b101 = M2 "In Service") */
+#define MICE_MSG			0x05
+
+uint8_t mice_encode(const GNSS_Fix *fix, char *dst_call, char *info);
+
+#endif /* INC_MICE_H_ */
@@ -73,8 +73,48 @@
 #define FDEV_DFM			0x90000
 
 
-/* number of retries for SPI transmission (reading CTS) */
-#define SI_TIMEOUT		100
+/* maximum wait for CTS, covers the boot after POWER_UP */
+#define SI_CTS_TIMEOUT_US	20000
+/* maximum wait for a state reached by START_TX / CHANGE_STATE */
+#define SI_STATE_TIMEOUT_US	2000
+
+/* return codes */
+#define SI_OK				0
+#define SI_ERR_CTS_TIMEOUT	1
+#define SI_ERR_STATE_TIMEOUT	2
+#define SI_ERR_BUSY			3
+
+/* CTS wait statistics of one command, times in core clock cycles */
+typedef struct {
+	uint16_t count;
+	uint16_t timeouts;
+	uint32_t total;
+	uint32_t max;
+} si4060_cts_stat;
+
+/* power states for si4060_set_power, ordered by power consumption.
+ * apart from SHUTDOWN they are the CHANGE_STATE states. SLEEP is the same
+ * state as STANDBY as long as the wake up timer is not used. */
+#define SI_PWR_SHUTDOWN		0x00	/* SDN high, registers are restored on wake up */
+#define SI_PWR_STANDBY		STATE_SLEEP
+#define SI_PWR_SLEEP		STATE_SLEEP
+#define SI_PWR_SPI_ACTIVE	STATE_SPI_ACTIVE
+#define SI_PWR_READY		STATE_READY
+#define SI_PWR_TX_TUNE		STATE_TX_TUNE
+#define SI_PWR_TX			STATE_TX
+
+/* slack kept by si4060_power_for_deadline on top of the wake up time */
+#define SI_WAKE_MARGIN_US	1000
+
+/* commands with CTS wait statistics, SI_CMD_POR is the wait after reset */
+#define SI_STAT_CMDS		10
+#define SI_CMD_POR			0xff
+
+/* maximum number of properties in one SET_PROPERTY command */
+#define SI_MAX_PROPS	12
+
+/* TX filter coefficients coeff[0..8], 6dB@1200Hz, 4400 Hz (bad stopband) */
+#define SI_TX_FILTER_COEFF		0x81, 0x9f, 0xc4, 0xee, 0x18, 0x3e, 0x5c, 0x70, 0x76
 
 /* function prototypes */
 
@@ -89,7 +129,7 @@ void si4060_freq_aprs_brazil(void);
 void si4060_freq_2m_rtty(void);
 void si4060_freq_aprs_dfm17(void);
 
-void si4060_set_offset(uint16_t offset);
+uint8_t si4060_set_offset(uint16_t offset);
 void si4060_start_tx(uint8_t channel);
 void si4060_stop_tx(void);
 void si4060_shutdown(void);
@@ -97,16 +137,28 @@ void si4060_wakeup(void);
 void si4060_reset(void);
 uint16_t si4060_part_info(void);
 uint8_t si4060_get_cts(uint8_t read_response);
+si4060_cts_stat *si4060_get_cts_stats(uint8_t cmd);
+void si4060_print_stats(void);
+uint8_t si4060_set_power(uint8_t state);
+uint8_t si4060_get_power(void);
+uint8_t si4060_power_for_deadline(uint32_t us);
+uint8_t si4060_get_state(void);
+uint8_t si4060_wait_state(uint8_t state, uint32_t timeout_us);
 uint8_t si4060_read_cmd_buf(uint8_t deselect);
 void si4060_power_up(void);
-void si4060_change_state(uint8_t state);
+uint8_t si4060_change_state(uint8_t state);
 void si4060_nop(void);
+void si4060_invalidate_shadow(void);
 void si4060_set_property_8(uint8_t group, uint8_t prop, uint8_t val);
 uint8_t si4060_get_property_8(uint8_t group, uint8_t prop);
 void si4060_set_property_16(uint8_t group, uint8_t prop, uint16_t val);
-void si4060_set_property_16_nocts(uint8_t group, uint8_t prop, uint16_t val);
+uint8_t si4060_set_property_16_nocts(uint8_t group, uint8_t prop, uint16_t val);
 void si4060_set_property_24(uint8_t group, uint8_t prop, uint32_t val);
 void si4060_set_property_32(uint8_t group, uint8_t prop, uint32_t val);
+uint8_t si4060_set_properties(uint8_t group, uint8_t prop, const uint8_t *vals, uint8_t count);
+uint8_t si4060_replay(const uint8_t *cfg);
+void si4060_set_freq_control(uint8_t inte, uint32_t frac);
+void si4060_set_freq_dev(uint32_t dev, uint16_t offset);
 void si4060_setup(uint8_t mod_type);
 void si4060_set_filter(void);
 void si4060_gpio_pin_cfg(uint8_t gpio0, uint8_t gpio1, uint8_t gpio2, uint8_t gpio3, uint8_t drvstrength);
@@ -123,6 +175,7 @@ void __delay_cycles(uint32_t delay);
 #define CMD_GET_PROPERTY				0x12
 #define CMD_GPIO_PIN_CFG				0x13
 #define CMD_START_TX					0x31
+#define CMD_REQUEST_DEVICE_STATE		0x33
 #define CMD_CHANGE_STATE				0x34
 #define CMD_READ_CMD_BUF				0x44
 
@@ -152,6 +205,12 @@ void __delay_cycles(uint32_t delay);
 #define GLOBAL_CLK_CFG					0x01
 #define GLOBAL_CONFIG					0x03
 
+/* interrupt control properties */
+#define INT_CTL_ENABLE					0x00
+
+/* fast response register properties */
+#define FRR_CTL_A_MODE					0x00
+
 /* preamble properties */
 #define PREAMBLE_TX_LENGTH				0x00
 
@@ -0,0 +1,50 @@
+/**
+  ******************************************************************************
+  * @file    si4063_bus.h
+  * @brief   This file contains the hardware interface of the Si4063 driver
+  *          in the si4063_bus.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * si4063.c reaches the radio only through these functions: SPI1 with
+  * nSEL, the SDN pin, the CTS pin (Si4063 GPIO2) and a time base.
+  * si4063_bus.c implements them for the DFM17. Linking another
+  * implementation, e.g. a model of the radio, runs the driver unchanged.
+  * GPIO3, the modulation input, is driven through the gpio.c functions.
+  ******************************************************************************
+  */
+
+#ifndef INC_SI4063_BUS_H_
+#define INC_SI4063_BUS_H_
+
+#include <inttypes.h>
+
+void si4060_bus_select(void);
+uint8_t si4060_bus_try_select(void);
+void si4060_bus_deselect(void);
+void si4060_bus_write(uint8_t data);
+uint8_t si4060_bus_read(void);
+void si4060_bus_send(const uint8_t *cmd, uint8_t len);
+void si4060_bus_wait(void);
+void si4060_bus_sdn(uint8_t shutdown);
+uint8_t si4060_bus_cts(void);
+void si4060_bus_delay_us(uint16_t us);
+uint32_t si4060_bus_cycles(void);
+
+#endif /* INC_SI4063_BUS_H_ */
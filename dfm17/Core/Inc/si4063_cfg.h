@@ -0,0 +1,67 @@
+/**
+  ******************************************************************************
+  * @file    si4063_cfg.h
+  * @brief   This file contains the precompiled Si4063 configuration streams
+  *          of the si4063_cfg.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * A configuration stream is a sequence of Si4063 commands, each stored as
+  * its length followed by the command bytes. A length of 0 ends the stream.
+  * si4060_replay() sends the commands in order and waits for CTS before
+  * each one. The streams are built at compile time from the same
+  * FDIV_* / FDEV_* macros as the si4060_freq_* setters.
+  ******************************************************************************
+  */
+
+#ifndef INC_SI4063_CFG_H_
+#define INC_SI4063_CFG_H_
+
+#include "si4063.h"
+
+/* big endian byte splitting of command arguments */
+#define SI_CFG_U8(v)		(uint8_t)(uint32_t)(v)
+#define SI_CFG_U16(v)		(uint8_t)((uint32_t)(v) >> 8), (uint8_t)(uint32_t)(v)
+#define SI_CFG_U24(v)		(uint8_t)((uint32_t)(v) >> 16), SI_CFG_U16(v)
+#define SI_CFG_U32(v)		(uint8_t)((uint32_t)(v) >> 24), SI_CFG_U24(v)
+
+/* header of a SET_PROPERTY record for count (<= SI_MAX_PROPS) properties */
+#define SI_CFG_SET_PROPERTY(group, prop, count) \
+	(4 + (count)), CMD_SET_PROPERTY, (group), (count), (prop)
+
+#define SI_CFG_END			0
+
+/* power up, GPIO, global, modem and TX filter setup, as si4060_power_up()
+ * followed by si4060_setup(MOD_TYPE_2GFSK) */
+extern const uint8_t si4060_cfg_setup[];
+
+/* modulation, band, deviation and synthesizer for one channel,
+ * as the si4060_freq_* function of the same name */
+extern const uint8_t si4060_cfg_aprs_dfm17[];
+extern const uint8_t si4060_cfg_aprs_reg1[];
+extern const uint8_t si4060_cfg_aprs_reg2[];
+extern const uint8_t si4060_cfg_aprs_cn[];
+extern const uint8_t si4060_cfg_aprs_jp[];
+extern const uint8_t si4060_cfg_aprs_thai[];
+extern const uint8_t si4060_cfg_aprs_nz[];
+extern const uint8_t si4060_cfg_aprs_aus[];
+extern const uint8_t si4060_cfg_aprs_brazil[];
+extern const uint8_t si4060_cfg_2m_rtty[];
+
+#endif /* INC_SI4063_CFG_H_ */
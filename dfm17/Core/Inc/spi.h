@@ -43,8 +43,30 @@ extern "C" {
 
 extern SPI_HandleTypeDef hspi1;
 
+/* USER CODE BEGIN Private variables */
+
+extern DMA_HandleTypeDef hdma_spi1_rx;
+extern DMA_HandleTypeDef hdma_spi1_tx;
+
+/* USER CODE END Private variables */
+
 /* USER CODE BEGIN Private defines */
 
+/* SPI1 runs from PCLK2, keep in sync with hspi1.Init.BaudRatePrescaler.
+ * 8 MHz is the fastest clock below the 10 MHz limit of the Si4063 */
+#define SPI1_PCLK_HZ			16000000UL
+#define SPI1_PRESCALER			2
+#define SPI1_CLK_HZ				(SPI1_PCLK_HZ / SPI1_PRESCALER)
+
+/* one SPI1 DMA transaction, see spi_xfer_submit */
+typedef struct spi_xfer {
+	const uint8_t *tx;		/* bytes to send */
+	uint8_t *rx;			/* received bytes, NULL to discard them */
+	uint16_t len;
+	void (*done)(struct spi_xfer *xfer);	/* called from the DMA interrupt, may be NULL */
+	struct spi_xfer *next;	/* queue link, owned by spi.c */
+} spi_xfer;
+
 /* USER CODE END Private defines */
 
 void MX_SPI1_Init(void);
@@ -57,9 +79,14 @@ void SpiWriteData(int size, uint8_t* data);
 void SpiReadData (int size, uint8_t *data);
 uint8_t SpiReadWrite(uint8_t byte);
 void spi_select(void);
+uint8_t spi_try_select(void);
 void spi_deselect(void);
 uint8_t spi_write(uint8_t data);
 uint8_t spi_read(void);
+void spi_set_prescaler(uint32_t prescaler);
+void spi_xfer_submit(spi_xfer *xfer);
+uint8_t spi_xfer_busy(void);
+void spi_xfer_wait(void);
 
 /* USER CODE END Prototypes */
 
@@ -40,6 +40,12 @@ extern TIM_HandleTypeDef htim15;
 
 extern TIM_HandleTypeDef htim17;
 
+/* USER CODE BEGIN Private variables */
+
+extern DMA_HandleTypeDef hdma_tim15_up;
+
+/* USER CODE END Private variables */
+
 /* USER CODE BEGIN Private defines */
 
 /* USER CODE END Private defines */
@@ -51,10 +57,13 @@ void MX_TIM17_Init(void);
 
 /* USER CODE BEGIN Prototypes */
 
+void startCycleCounter(void);
+uint32_t getCycleCount(void);
 void delay_us(uint16_t us);
 void assertGpsLock(void);
 void startAprsTickTimer(void);
 void stopAprsTickTimer(void);
+void processAprsTick(void);
 void startGpsTickTimer(void);
 void stopGpsTickTimer(void);
 void startGpsLockTimer(void);
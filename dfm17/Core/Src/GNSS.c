@@ -28,347 +28,756 @@
  * - changing receive to use DMA
  * - added some additional values to GNSS_Init
  * - added an rx/tx interlock with DMA interrupts
+ * - permanent circular DMA reception, UBX frames parsed byte by byte
+ * - requests are queued and completed from the parser or by time out
+ * - NAV-PVT output enabled at GNSS_NAV_RATE_MS by GNSS_LoadConfig
+ * - fields decoded in place into the fixed point fix, no unions or floats
+ * - the link is raised to GNSS_BAUD_FAST by GNSS_LoadConfig
  ******************************************************************************
  */
 
 #include "GNSS.h"
 #include "gps.h"
+#include "tim.h"
 #include <stdio.h>
 
-volatile union u_Short uShort;
-volatile union i_Short iShort;
-volatile union u_Long uLong;
-volatile union i_Long iLong;
+/* UBX parser states */
+enum {
+	GNSS_RX_SYNC1,
+	GNSS_RX_SYNC2,
+	GNSS_RX_HEADER,
+	GNSS_RX_PAYLOAD,
+	GNSS_RX_CK_A,
+	GNSS_RX_CK_B,
+	GNSS_RX_SKIP
+};
+
+/* offset of the payload in the frame buffer */
+#define GNSS_HEADER_LEN		6
+
+/* payload offsets of the fields used, the messages are never copied */
+#define UNIQID_ID			4	/* SEC-UNIQID 32.19.1.1 */
+
+#define PVT_YEAR			4	/* NAV-PVT 32.17.15.1 */
+#define PVT_MONTH			6
+#define PVT_DAY				7
+#define PVT_HOUR			8
+#define PVT_MIN				9
+#define PVT_SEC				10
+#define PVT_FIXTYPE			20
+#define PVT_NUMSV			23
+#define PVT_LON				24
+#define PVT_LAT				28
+#define PVT_HMSL			36
+#define PVT_GSPEED			60
+#define PVT_HEADMOT			64
+
+#define TIMEUTC_YEAR		12	/* NAV-TIMEUTC 32.17.30.1 */
+#define TIMEUTC_MONTH		14
+#define TIMEUTC_DAY			15
+#define TIMEUTC_HOUR		16
+#define TIMEUTC_MIN			17
+#define TIMEUTC_SEC			18
+
+#define POSLLH_LON			4	/* NAV-POSLLH 32.17.14.1 */
+#define POSLLH_LAT			8
+#define POSLLH_HMSL			16
+
+static void GNSS_Dispatch(GNSS_StateHandle *GNSS);
+static void GNSS_Complete(GNSS_StateHandle *GNSS, uint8_t status);
+static void GNSS_ApplyBaud(GNSS_StateHandle *GNSS);
 
 /*!
  * Structure initialization.
  * @param GNSS Pointer to main GNSS structure.
  * @param huart Pointer to uart handle.
  */
-void GNSS_Init(GNSS_StateHandle *GNSS, UART_HandleTypeDef *huart, uint8_t *txDone, uint8_t *rxDone) {
+void GNSS_Init(GNSS_StateHandle *GNSS, UART_HandleTypeDef *huart) {
+	static const GNSS_Fix noFix = { 0 };
+
 	GNSS->huart = huart;
-	GNSS->txDone = txDone;
-	GNSS->rxDone = rxDone;
-	GNSS->year = 0;
-	GNSS->month = 0;
-	GNSS->day = 0;
-	GNSS->hour = 0;
-	GNSS->min = 0;
-	GNSS->sec = 0;
-	GNSS->fixType = 0;
-	GNSS->numSV = 0;
-	GNSS->lon = 0;
-	GNSS->lat = 0;
-	GNSS->height = 0;
-	GNSS->hMSL = 0;
-	GNSS->hAcc = 0;
-	GNSS->vAcc = 0;
-	GNSS->gSpeed = 0;
-	GNSS->headMot = 0;
 	GNSS->uniqueID[0] = 0;
 	GNSS->uniqueID[1] = 0;
 	GNSS->uniqueID[2] = 0;
 	GNSS->uniqueID[3] = 0;
 	GNSS->uniqueID[4] = 0;
 	GNSS->selectedMode = ModeNotSet;
+	GNSS->pvtPeriodic = 0;
+	GNSS->fixSeq = 0;
+	GNSS->fix = noFix;
+	GNSS->rxExpect = 0;
+	GNSS->rxErrors = 0;
+	GNSS->qHead = 0;
+	GNSS->qCount = 0;
+	GNSS->baud = huart->Init.BaudRate;
+	GNSS->pendingBaud = 0;
+	GNSS->latencyUs = 0;
+	GNSS->pvtLatencyUs[0] = 0;
+	GNSS->pvtLatencyUs[1] = 0;
+	GNSS->retry = NULL;
+
+	GNSS_StartRx(GNSS);
+}
+
+/*!
+ * (Re)start the permanent reception into the circular DMA ring.
+ * Also called after a UART error, which aborts the DMA.
+ * @param GNSS Pointer to main GNSS structure.
+ */
+void GNSS_StartRx(GNSS_StateHandle *GNSS) {
+	GNSS->rxPos = 0;
+	GNSS->rxState = GNSS_RX_SYNC1;
+	HAL_UARTEx_ReceiveToIdle_DMA(GNSS->huart, GNSS->rxRing, GNSS_RX_RING);
+}
 
+/*!
+ * Little endian 16 bit load from the receive buffer, any alignment.
+ */
+static uint16_t GNSS_LoadU16(const uint8_t *buf) {
+	return (uint16_t)(buf[0] | (buf[1] << 8));
 }
 
 /*!
- * Searching for a header in data buffer and matching class and message ID to buffer data.
+ * Little endian 32 bit load from the receive buffer, any alignment.
+ */
+static int32_t GNSS_LoadI32(const uint8_t *buf) {
+	return (int32_t)((uint32_t)buf[0] | ((uint32_t)buf[1] << 8)
+			| ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24));
+}
+
+/*!
+ * Publish a new fix snapshot. Called from the UART interrupt, never blocks.
+ * Readers that overlap with the update see an odd or changed fixSeq and retry.
  * @param GNSS Pointer to main GNSS structure.
+ * @param fix New fix.
  */
-void GNSS_ParseBuffer(GNSS_StateHandle *GNSS) {
-	//printf("Parsing Buffer...\r\n");
-	for (int var = 0; var <= 100; ++var) {
-		if (GNSS->uartWorkingBuffer[var] == 0xB5
-				&& GNSS->uartWorkingBuffer[var + 1] == 0x62) {
-			if (GNSS->uartWorkingBuffer[var + 2] == 0x27
-					&& GNSS->uartWorkingBuffer[var + 3] == 0x03) { //Look at: 32.19.1.1 u-blox 8 Receiver description
-				GNSS_ParseUniqID(GNSS);
-			} else if (GNSS->uartWorkingBuffer[var + 2] == 0x01
-					&& GNSS->uartWorkingBuffer[var + 3] == 0x21) { //Look at: 32.17.14.1 u-blox 8 Receiver description
-				GNSS_ParseNavigatorData(GNSS);
-			} else if (GNSS->uartWorkingBuffer[var + 2] == 0x01
-					&& GNSS->uartWorkingBuffer[var + 3] == 0x07) { //ook at: 32.17.30.1 u-blox 8 Receiver description
-				GNSS_ParsePVTData(GNSS);
-			} else if (GNSS->uartWorkingBuffer[var + 2] == 0x01
-					&& GNSS->uartWorkingBuffer[var + 3] == 0x02) { // Look at: 32.17.15.1 u-blox 8 Receiver description
-				GNSS_ParsePOSLLHData(GNSS);
+static void GNSS_PublishFix(GNSS_StateHandle *GNSS, const GNSS_Fix *fix) {
+	GNSS->fixSeq++;
+	__DMB();
+	GNSS->fix = *fix;
+	__DMB();
+	GNSS->fixSeq++;
+}
+
+/*!
+ * Consistent copy of the last fix, lock-free (seqlock reader).
+ * Retries if the parser published a fix while copying, interrupts stay enabled.
+ * @param GNSS Pointer to main GNSS structure.
+ * @param fix Destination of the copy.
+ */
+void GNSS_GetFix(GNSS_StateHandle *GNSS, GNSS_Fix *fix) {
+	uint32_t seq;
+
+	do {
+		seq = GNSS->fixSeq;
+		__DMB();
+		*fix = GNSS->fix;
+		__DMB();
+	} while ((seq & 0x01) || seq != GNSS->fixSeq);
+}
+
+/*!
+ * Feed one received byte to the UBX parser.
+ * Frames are assembled in uartWorkingBuffer, the checksum runs along (32.4 UBX Checksum).
+ * @param GNSS Pointer to main GNSS structure.
+ * @param c Received byte.
+ */
+static void GNSS_ParseByte(GNSS_StateHandle *GNSS, uint8_t c) {
+	switch (GNSS->rxState) {
+	case GNSS_RX_SYNC1:
+		if (c == 0xB5) {
+			GNSS->rxState = GNSS_RX_SYNC2;
+		}
+		break;
+	case GNSS_RX_SYNC2:
+		if (c == 0x62) {
+			GNSS->uartWorkingBuffer[0] = 0xB5;
+			GNSS->uartWorkingBuffer[1] = 0x62;
+			GNSS->rxIdx = 2;
+			GNSS->rxCkA = 0;
+			GNSS->rxCkB = 0;
+			GNSS->rxState = GNSS_RX_HEADER;
+		} else if (c != 0xB5) {
+			GNSS->rxState = GNSS_RX_SYNC1;
+		}
+		break;
+	case GNSS_RX_HEADER:
+		GNSS->uartWorkingBuffer[GNSS->rxIdx++] = c;
+		GNSS->rxCkA += c;
+		GNSS->rxCkB += GNSS->rxCkA;
+		if (GNSS->rxIdx == GNSS_HEADER_LEN) {
+			GNSS->rxLen = GNSS->uartWorkingBuffer[4]
+					| (GNSS->uartWorkingBuffer[5] << 8);
+			if (GNSS->rxLen > GNSS_SKIP_MAX) {
+				// the length is not checksummed yet, do not skip blindly
+				GNSS->rxErrors++;
+				GNSS->rxState = GNSS_RX_SYNC1;
+			} else if (GNSS->rxLen > GNSS_FRAME_MAX - GNSS_HEADER_LEN) {
+				// not one of ours, skip payload and checksum
+				GNSS->rxIdx = 0;
+				GNSS->rxLen += 2;
+				GNSS->rxState = GNSS_RX_SKIP;
+			} else if (GNSS->rxLen == 0) {
+				GNSS->rxState = GNSS_RX_CK_A;
+			} else {
+				GNSS->rxState = GNSS_RX_PAYLOAD;
 			}
 		}
+		break;
+	case GNSS_RX_PAYLOAD:
+		GNSS->uartWorkingBuffer[GNSS->rxIdx++] = c;
+		GNSS->rxCkA += c;
+		GNSS->rxCkB += GNSS->rxCkA;
+		if (GNSS->rxIdx == GNSS_HEADER_LEN + GNSS->rxLen) {
+			GNSS->rxState = GNSS_RX_CK_A;
+		}
+		break;
+	case GNSS_RX_CK_A:
+		if (c == GNSS->rxCkA) {
+			GNSS->rxState = GNSS_RX_CK_B;
+		} else {
+			GNSS->rxErrors++;
+			GNSS->rxState = GNSS_RX_SYNC1;
+		}
+		break;
+	case GNSS_RX_CK_B:
+		if (c == GNSS->rxCkB) {
+			GNSS_Dispatch(GNSS);
+		} else {
+			GNSS->rxErrors++;
+		}
+		GNSS->rxState = GNSS_RX_SYNC1;
+		break;
+	case GNSS_RX_SKIP:
+		if (++GNSS->rxIdx == GNSS->rxLen) {
+			GNSS->rxState = GNSS_RX_SYNC1;
+		}
+		break;
+	default:
+		GNSS->rxState = GNSS_RX_SYNC1;
+		break;
 	}
-	memset(GNSS->uartWorkingBuffer, 0, 101);
 }
 
 /*!
- * Make request for unique chip ID data.
+ * Parse the receive ring up to the DMA write position.
+ * Called from the half transfer, transfer complete and idle line events.
  * @param GNSS Pointer to main GNSS structure.
+ * @param head Ring position the DMA has written up to.
  */
-void GNSS_GetUniqID(GNSS_StateHandle *GNSS) {
+void GNSS_ParseBuffer(GNSS_StateHandle *GNSS, uint16_t head) {
+	if (head >= GNSS_RX_RING) {
+		head = 0;
+	}
+	while (GNSS->rxPos != head) {
+		GNSS_ParseByte(GNSS, GNSS->rxRing[GNSS->rxPos]);
+		if (++GNSS->rxPos == GNSS_RX_RING) {
+			GNSS->rxPos = 0;
+		}
+	}
+	// a rate switch restarts the ring, never inside the loop above
+	GNSS_ApplyBaud(GNSS);
+}
+
+/* complete frames handed to the parse functions, by class, ID and minimum payload length */
+static const struct {
+	uint8_t class;
+	uint8_t id;
+	uint8_t len;
+	void (*parse)(GNSS_StateHandle *GNSS, const uint8_t *payload);
+} GNSS_Handlers[] = {
+	{ 0x27, 0x03,  9, GNSS_ParseUniqID },			// 32.19.1.1 SEC-UNIQID
+	{ 0x01, 0x21, 20, GNSS_ParseNavigatorData },	// 32.17.30.1 NAV-TIMEUTC
+	{ 0x01, 0x07, 92, GNSS_ParsePVTData },			// 32.17.15.1 NAV-PVT
+	{ 0x01, 0x02, 28, GNSS_ParsePOSLLHData },		// 32.17.14.1 NAV-POSLLH
+};
+
+/*!
+ * Hand a complete, checksum verified frame to its parse function.
+ * Answers and acknowledges (ACK-ACK, ACK-NAK) complete the request in progress.
+ * @param GNSS Pointer to main GNSS structure.
+ */
+static void GNSS_Dispatch(GNSS_StateHandle *GNSS) {
+	uint8_t class = GNSS->uartWorkingBuffer[2];
+	uint8_t id = GNSS->uartWorkingBuffer[3];
+	uint16_t msg = (class << 8) | id;
+	uint8_t status = GNSS_OK;
+
+	if (class == 0x05 && GNSS->rxLen >= 2) {
+		// acknowledge, the payload names the acknowledged message
+		msg = (GNSS->uartWorkingBuffer[6] << 8) | GNSS->uartWorkingBuffer[7];
+		if (id == 0x00) {
+			status = GNSS_ERR_NAK;
+		}
+	} else {
+		for (uint8_t i = 0; i < sizeof(GNSS_Handlers) / sizeof(GNSS_Handlers[0]); i++) {
+			if (GNSS_Handlers[i].class == class && GNSS_Handlers[i].id == id) {
+				if (GNSS->rxLen >= GNSS_Handlers[i].len) {
+					GNSS_Handlers[i].parse(GNSS,
+							&GNSS->uartWorkingBuffer[GNSS_HEADER_LEN]);
+				}
+				break;
+			}
+		}
+	}
+
+	if (GNSS->rxExpect != 0 && msg == GNSS->rxExpect) {
+		GNSS_Complete(GNSS, status);
+	}
+}
+
+/*!
+ * Send the request at the head of the queue. Interrupts are disabled.
+ * @param GNSS Pointer to main GNSS structure.
+ */
+static void GNSS_Start(GNSS_StateHandle *GNSS) {
+	const GNSS_Request *req = &GNSS->queue[GNSS->qHead];
+
+	GNSS->rxExpect = (req->msg[2] << 8) | req->msg[3];
+	GNSS->reqStart = HAL_GetTick();
+	GNSS->reqCycles = getCycleCount();
+	HAL_UART_Transmit_DMA(GNSS->huart, (uint8_t *)req->msg, req->len);
+}
+
+/*!
+ * Carry out a rate switch left by GNSS_Complete: reconfigure USART2, restart
+ * the receive ring and start the request that waited for the switch.
+ * Called once the parser is no longer walking the ring.
+ * @param GNSS Pointer to main GNSS structure.
+ */
+static void GNSS_ApplyBaud(GNSS_StateHandle *GNSS) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if (GNSS->pendingBaud) {
+		HAL_UART_AbortReceive(GNSS->huart);
+		GNSS->huart->Init.BaudRate = GNSS->pendingBaud;
+		HAL_UART_Init(GNSS->huart);
+		GNSS->baud = GNSS->pendingBaud;
+		GNSS->pendingBaud = 0;
+		GNSS_StartRx(GNSS);
+		if (GNSS->qCount) {
+			GNSS_Start(GNSS);
+		}
+	}
+	__set_PRIMASK(primask);
+}
+
+/*!
+ * Finish the request in progress, start the next queued one and then report
+ * the finished one, so the callback may already queue a new request.
+ * A time out is checked again with interrupts disabled: the answer may have
+ * completed the request, and started the next one, since the caller looked.
+ * @param GNSS Pointer to main GNSS structure.
+ * @param status GNSS_OK, GNSS_ERR_NAK or GNSS_ERR_TIMEOUT.
+ */
+static void GNSS_Complete(GNSS_StateHandle *GNSS, uint8_t status) {
+	uint32_t primask = __get_PRIMASK();
+	GNSS_Request req;
+
+	__disable_irq();
+	if (GNSS->qCount == 0 || (status == GNSS_ERR_TIMEOUT
+			&& HAL_GetTick() - GNSS->reqStart < GNSS_TIMEOUT_MS)) {
+		__set_PRIMASK(primask);
+		return;
+	}
+	req = GNSS->queue[GNSS->qHead];
+	GNSS->rxExpect = 0;
+	if (status == GNSS_OK) {
+		GNSS->latencyUs = (getCycleCount() - GNSS->reqCycles)
+				/ (SystemCoreClock / 1000000);
+	}
+	if (req.baud) {
+		// the frame is out and answered or timed out, switch before the
+		// next request goes out (GNSS_ApplyBaud)
+		GNSS->pendingBaud = req.baud;
+	}
+	GNSS->qHead = (GNSS->qHead + 1) % GNSS_QUEUE_LEN;
+	if (--GNSS->qCount && !GNSS->pendingBaud) {
+		GNSS_Start(GNSS);
+	}
+	__set_PRIMASK(primask);
+
+	if (req.done) {
+		req.done(GNSS, status);
+	}
+}
+
+/*!
+ * Queue a UBX frame, returns at once. The answer is handled by the parser.
+ * Can be called from interrupts and from a done callback.
+ * @param GNSS Pointer to main GNSS structure.
+ * @param msg Complete UBX frame, has to stay valid until done.
+ * @param len Length of the frame.
+ * @param done Called with the result, may be NULL.
+ * @return GNSS_OK if queued, GNSS_ERR_BUSY if the queue is full.
+ */
+uint8_t GNSS_Submit(GNSS_StateHandle *GNSS, const uint8_t *msg, uint16_t len,
+		void (*done)(GNSS_StateHandle *GNSS, uint8_t status)) {
+	uint32_t primask = __get_PRIMASK();
+	GNSS_Request *req;
+
+	__disable_irq();
+	if (GNSS->qCount == GNSS_QUEUE_LEN) {
+		__set_PRIMASK(primask);
+		return GNSS_ERR_BUSY;
+	}
+	req = &GNSS->queue[(GNSS->qHead + GNSS->qCount) % GNSS_QUEUE_LEN];
+	req->msg = msg;
+	req->len = len;
+	req->baud = 0;
+	req->done = done;
+	if (GNSS->qCount++ == 0 && !GNSS->pendingBaud) {
+		GNSS_Start(GNSS);
+	}
+	__set_PRIMASK(primask);
+
+	return GNSS_OK;
+}
+
+/*!
+ * Time out the request in progress after GNSS_TIMEOUT_MS without an answer.
+ * Called from the SysTick interrupt.
+ * @param GNSS Pointer to main GNSS structure.
+ */
+void GNSS_Tick(GNSS_StateHandle *GNSS) {
+	void (*retry)(GNSS_StateHandle *GNSS);
+	uint32_t primask;
+
+	// unlocked look first, GNSS_Complete checks again with interrupts disabled
+	if (GNSS->qCount != 0 && HAL_GetTick() - GNSS->reqStart >= GNSS_TIMEOUT_MS) {
+		GNSS_Complete(GNSS, GNSS_ERR_TIMEOUT);
+		GNSS_ApplyBaud(GNSS);
+	}
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	retry = GNSS->retry;
+	GNSS->retry = NULL;
+	__set_PRIMASK(primask);
+	if (retry) {
+		retry(GNSS);
+	}
+}
+
+/*!
+ * Queue a request for unique chip ID data.
+ * @param GNSS Pointer to main GNSS structure.
+ * @param done Called when the answer is parsed or timed out, may be NULL.
+ * @return GNSS_OK if queued, GNSS_ERR_BUSY if the queue is full.
+ */
+uint8_t GNSS_GetUniqID(GNSS_StateHandle *GNSS, void (*done)(GNSS_StateHandle *GNSS, uint8_t status)) {
 	//printf("Sending GetUniqID...\r\n");
-	GNSS->txDone = 0x00;
-	GNSS->rxDone = 0x00;
-	HAL_UART_Transmit_DMA(GNSS->huart, getDeviceID,
-			sizeof(getDeviceID) / sizeof(uint8_t));
-	HAL_UART_Receive_DMA(GNSS->huart, GNSS->uartWorkingBuffer, 17);
-	while((GNSS->txDone == 0x00) || (GNSS->rxDone == 0x00)) {};
+	return GNSS_Submit(GNSS, getDeviceID, sizeof(getDeviceID), done);
 }
 
 /*!
- * Make request for UTC time solution data.
+ * Queue a request for UTC time solution data.
  * @param GNSS Pointer to main GNSS structure.
+ * @param done Called when the answer is parsed or timed out, may be NULL.
+ * @return GNSS_OK if queued, GNSS_ERR_BUSY if the queue is full.
  */
-void GNSS_GetNavigatorData(GNSS_StateHandle *GNSS) {
+uint8_t GNSS_GetNavigatorData(GNSS_StateHandle *GNSS, void (*done)(GNSS_StateHandle *GNSS, uint8_t status)) {
 	//printf("Sending GetNavigatorData...\r\n");
-	GNSS->txDone = 0x00;
-	GNSS->rxDone = 0x00;
-	HAL_UART_Transmit_DMA(GNSS->huart, getNavigatorData,
-			sizeof(getNavigatorData) / sizeof(uint8_t));
-	HAL_UART_Receive_DMA(GNSS->huart, GNSS->uartWorkingBuffer, 28);
-	while((GNSS->txDone == 0x00) || (GNSS->rxDone == 0x00)) {};
+	return GNSS_Submit(GNSS, getNavigatorData, sizeof(getNavigatorData), done);
 }
 
 /*!
- * Make request for geodetic position solution data.
+ * Queue a request for geodetic position solution data.
  * @param GNSS Pointer to main GNSS structure.
+ * @param done Called when the answer is parsed or timed out, may be NULL.
+ * @return GNSS_OK if queued, GNSS_ERR_BUSY if the queue is full.
  */
-void GNSS_GetPOSLLHData(GNSS_StateHandle *GNSS) {
+uint8_t GNSS_GetPOSLLHData(GNSS_StateHandle *GNSS, void (*done)(GNSS_StateHandle *GNSS, uint8_t status)) {
 	//printf("Sending GetPOSLLHData...\r\n");
-	GNSS->txDone = 0x00;
-	GNSS->rxDone = 0x00;
-	HAL_UART_Transmit_DMA(GNSS->huart, getPOSLLHData,
-			sizeof(getPOSLLHData) / sizeof(uint8_t));
-	HAL_UART_Receive_DMA(GNSS->huart, GNSS->uartWorkingBuffer, 36);
-	while((GNSS->txDone == 0x00) || (GNSS->rxDone == 0x00)) {};
+	return GNSS_Submit(GNSS, getPOSLLHData, sizeof(getPOSLLHData), done);
 }
 
 /*!
- * Make request for navigation position velocity time solution data.
+ * Queue a request for navigation position velocity time solution data.
  * @param GNSS Pointer to main GNSS structure.
+ * @param done Called when the answer is parsed or timed out, may be NULL.
+ * @return GNSS_OK if queued, GNSS_ERR_BUSY if the queue is full.
  */
-void GNSS_GetPVTData(GNSS_StateHandle *GNSS) {
+uint8_t GNSS_GetPVTData(GNSS_StateHandle *GNSS, void (*done)(GNSS_StateHandle *GNSS, uint8_t status)) {
 	//printf("Sending GetPVTData...\r\n");
-	GNSS->txDone = 0x00;
-	GNSS->rxDone = 0x00;
-	HAL_UART_Transmit_DMA(GNSS->huart, getPVTData,
-			sizeof(getPVTData) / sizeof(uint8_t));
-	HAL_UART_Receive_DMA(GNSS->huart, GNSS->uartWorkingBuffer, 100);
-	while((GNSS->txDone == 0x00) || (GNSS->rxDone == 0x00)) {};
+	return GNSS_Submit(GNSS, getPVTData, sizeof(getPVTData), done);
 }
 
 /*!
  * Parse data to unique chip ID standard.
  * Look at: 32.19.1.1 u-blox 8 Receiver description
  * @param GNSS Pointer to main GNSS structure.
+ * @param payload SEC-UNIQID payload.
  */
-void GNSS_ParseUniqID(GNSS_StateHandle *GNSS) {
+void GNSS_ParseUniqID(GNSS_StateHandle *GNSS, const uint8_t *payload) {
 	//printf("Parsing GetUniqID...\r\n");
 
-	if(!checkUbxCrc(GNSS->uartWorkingBuffer, 17)) {
-		return;
-	};
 	for (int var = 0; var < 5; ++var) {
-		GNSS->uniqueID[var] = GNSS->uartWorkingBuffer[10 + var];
+		GNSS->uniqueID[var] = payload[UNIQID_ID + var];
 	}
 }
 
 /*!
- * Changing the GNSS mode.
+ * A mode change that was not acknowledged is tried again on the next update.
+ */
+static void GNSS_ModeDone(GNSS_StateHandle *GNSS, uint8_t status) {
+	if (status != GNSS_OK) {
+		GNSS->selectedMode = ModeNotSet;
+	}
+}
+
+/*!
+ * Changing the GNSS mode, queued.
  * Look at: 32.10.19 u-blox 8 Receiver description
+ * @return GNSS_OK if queued, GNSS_ERR_BUSY if the queue is full.
  */
-void GNSS_SetMode(GNSS_StateHandle *GNSS, short gnssMode) {
-	GNSS->txDone = 0x00;
-	GNSS->rxDone = 0x00;
+uint8_t GNSS_SetMode(GNSS_StateHandle *GNSS, short gnssMode) {
+	const uint8_t *msg = NULL;
 
 	if (gnssMode == 0) {
-		HAL_UART_Transmit_DMA(GNSS->huart, setPortableMode,sizeof(setPortableMode) / sizeof(uint8_t));
+		msg = setPortableMode;
 	} else if (gnssMode == 1) {
-		HAL_UART_Transmit_DMA(GNSS->huart, setStationaryMode,sizeof(setStationaryMode) / sizeof(uint8_t));
+		msg = setStationaryMode;
 	} else if (gnssMode == 2) {
-		HAL_UART_Transmit_DMA(GNSS->huart, setPedestrianMode,sizeof(setPedestrianMode) / sizeof(uint8_t));
+		msg = setPedestrianMode;
 	} else if (gnssMode == 3) {
-		HAL_UART_Transmit_DMA(GNSS->huart, setAutomotiveMode,sizeof(setAutomotiveMode) / sizeof(uint8_t));
+		msg = setAutomotiveMode;
 	} else if (gnssMode == 4) {
-		HAL_UART_Transmit_DMA(GNSS->huart, setAutomotiveMode,sizeof(setAutomotiveMode) / sizeof(uint8_t));
+		msg = setAutomotiveMode;
 	} else if (gnssMode == 5) {
-		HAL_UART_Transmit_DMA(GNSS->huart, setAirbone1GMode,sizeof(setAirbone1GMode) / sizeof(uint8_t));
+		msg = setAirbone1GMode;
 	} else if (gnssMode == 6) {
-		HAL_UART_Transmit_DMA(GNSS->huart, setAirbone2GMode,sizeof(setAirbone2GMode) / sizeof(uint8_t));
+		msg = setAirbone2GMode;
 	} else if (gnssMode == 7) {
-		HAL_UART_Transmit_DMA(GNSS->huart, setAirbone4GMode,sizeof(setAirbone4GMode) / sizeof(uint8_t));
+		msg = setAirbone4GMode;
 	} else if (gnssMode == 8) {
-		HAL_UART_Transmit_DMA(GNSS->huart, setWristMode,sizeof(setWristMode) / sizeof(uint8_t));
+		msg = setWristMode;
 	} else if (gnssMode == 9) {
-		HAL_UART_Transmit_DMA(GNSS->huart, setBikeMode,sizeof(setBikeMode) / sizeof(uint8_t));
+		msg = setBikeMode;
+	}
+	if (msg == NULL
+			|| GNSS_Submit(GNSS, msg, sizeof(setPortableMode), GNSS_ModeDone) != GNSS_OK) {
+		return GNSS_ERR_BUSY;
 	}
-	HAL_UART_Receive_DMA(GNSS->huart, GNSS->uartWorkingBuffer, 10);
-	while((GNSS->txDone == 0x00) || (GNSS->rxDone == 0x00)) {};
 
 	GNSS->selectedMode = gnssMode;
+	return GNSS_OK;
 }
 /*!
  * Parse data to navigation position velocity time solution standard.
  * Look at: 32.17.15.1 u-blox 8 Receiver description.
  * @param GNSS Pointer to main GNSS structure.
+ * @param payload NAV-PVT payload.
  */
-void GNSS_ParsePVTData(GNSS_StateHandle *GNSS) {
+void GNSS_ParsePVTData(GNSS_StateHandle *GNSS, const uint8_t *payload) {
+	GNSS_Fix fix;
 	//printf("Parsing PVT Data...\r\n");
 
-	if(!checkUbxCrc(GNSS->uartWorkingBuffer, 100)) { return; };
-
-	uShort.bytes[0] = GNSS->uartWorkingBuffer[10];
-	GNSS->yearBytes[0]=GNSS->uartWorkingBuffer[10];
-	uShort.bytes[1] = GNSS->uartWorkingBuffer[11];
-	GNSS->yearBytes[1]=GNSS->uartWorkingBuffer[11];
-	GNSS->year = uShort.uShort;
-	GNSS->month = GNSS->uartWorkingBuffer[12];
-	GNSS->day = GNSS->uartWorkingBuffer[13];
-	GNSS->hour = GNSS->uartWorkingBuffer[14];
-	GNSS->min = GNSS->uartWorkingBuffer[15];
-	GNSS->sec = GNSS->uartWorkingBuffer[16];
-	GNSS->fixType = GNSS->uartWorkingBuffer[26];
-	GNSS->numSV = GNSS->uartWorkingBuffer[29];
-
-	for (int var = 0; var < 4; ++var) {
-		iLong.bytes[var] = GNSS->uartWorkingBuffer[var + 30];
-		GNSS->lonBytes[var]= GNSS->uartWorkingBuffer[var + 30];
-	}
-	GNSS->lon = iLong.iLong;
-	GNSS->fLon=(float)iLong.iLong/10000000.0;
-	for (int var = 0; var < 4; ++var) {
-		iLong.bytes[var] = GNSS->uartWorkingBuffer[var + 34];
-		GNSS->latBytes[var]=GNSS->uartWorkingBuffer[var + 34];
-	}
-	GNSS->lat = iLong.iLong;
-	GNSS->fLat=(float)iLong.iLong/10000000.0;
-	for (int var = 0; var < 4; ++var) {
-		iLong.bytes[var] = GNSS->uartWorkingBuffer[var + 38];
-	}
-	GNSS->height = iLong.iLong;
-
-	for (int var = 0; var < 4; ++var) {
-		iLong.bytes[var] = GNSS->uartWorkingBuffer[var + 42];
-		GNSS->hMSLBytes[var] = GNSS->uartWorkingBuffer[var + 42];
-	}
-	GNSS->hMSL = iLong.iLong;
-
-	for (int var = 0; var < 4; ++var) {
-		uLong.bytes[var] = GNSS->uartWorkingBuffer[var + 46];
-	}
-	GNSS->hAcc = uLong.uLong;
-
-	for (int var = 0; var < 4; ++var) {
-		uLong.bytes[var] = GNSS->uartWorkingBuffer[var + 50];
-	}
-	GNSS->vAcc = uLong.uLong;
-
-	for (int var = 0; var < 4; ++var) {
-		iLong.bytes[var] = GNSS->uartWorkingBuffer[var + 66];
-		GNSS->gSpeedBytes[var] = GNSS->uartWorkingBuffer[var + 66];
-	}
-	GNSS->gSpeed = iLong.iLong;
-
-	for (int var = 0; var < 4; ++var) {
-		iLong.bytes[var] = GNSS->uartWorkingBuffer[var + 70];
-	}
-	GNSS->headMot = iLong.iLong * 1e-5; // todo I'm not sure this good options.
+	fix.year = GNSS_LoadU16(&payload[PVT_YEAR]);
+	fix.month = payload[PVT_MONTH];
+	fix.day = payload[PVT_DAY];
+	fix.hour = payload[PVT_HOUR];
+	fix.min = payload[PVT_MIN];
+	fix.sec = payload[PVT_SEC];
+	fix.fixType = payload[PVT_FIXTYPE];
+	fix.numSV = payload[PVT_NUMSV];
+	fix.lon = GNSS_LoadI32(&payload[PVT_LON]);
+	fix.lat = GNSS_LoadI32(&payload[PVT_LAT]);
+	fix.hMSL = GNSS_LoadI32(&payload[PVT_HMSL]);
+	fix.gSpeed = GNSS_LoadI32(&payload[PVT_GSPEED]);
+	fix.headMot = GNSS_LoadI32(&payload[PVT_HEADMOT]);
+	GNSS_PublishFix(GNSS, &fix);
 }
 
 /*!
- * Parse data to UTC time solution standard.
+ * Parse data to UTC time solution standard, updates the time of the fix.
  * Look at: 32.17.30.1 u-blox 8 Receiver description.
  * @param GNSS Pointer to main GNSS structure.
+ * @param payload NAV-TIMEUTC payload.
  */
-void GNSS_ParseNavigatorData(GNSS_StateHandle *GNSS) {
+void GNSS_ParseNavigatorData(GNSS_StateHandle *GNSS, const uint8_t *payload) {
+	// the parser is the only writer, fix can be read without the seqlock
+	GNSS_Fix fix = GNSS->fix;
 	//printf("Parsing Navigator Data...\r\n");
 
-	//uint8_t res = checkUbxCrc(GNSS->uartWorkingBuffer, 100); // todo implement crc, need packet length
-	//if(!checkUbxCrc(GNSS->uartWorkingBuffer, 100)) { return; };
-
-
-	uShort.bytes[0] = GNSS->uartWorkingBuffer[18];
-	uShort.bytes[1] = GNSS->uartWorkingBuffer[19];
-	GNSS->year = uShort.uShort;
-	GNSS->month = GNSS->uartWorkingBuffer[20];
-	GNSS->day = GNSS->uartWorkingBuffer[21];
-	GNSS->hour = GNSS->uartWorkingBuffer[22];
-	GNSS->min = GNSS->uartWorkingBuffer[23];
-	GNSS->sec = GNSS->uartWorkingBuffer[24];
+	fix.year = GNSS_LoadU16(&payload[TIMEUTC_YEAR]);
+	fix.month = payload[TIMEUTC_MONTH];
+	fix.day = payload[TIMEUTC_DAY];
+	fix.hour = payload[TIMEUTC_HOUR];
+	fix.min = payload[TIMEUTC_MIN];
+	fix.sec = payload[TIMEUTC_SEC];
+	GNSS_PublishFix(GNSS, &fix);
 }
 
 /*!
- * Parse data to geodetic position solution standard.
+ * Parse data to geodetic position solution standard, updates the position of the fix.
  * Look at: 32.17.14.1 u-blox 8 Receiver description.
  * @param GNSS Pointer to main GNSS structure.
+ * @param payload NAV-POSLLH payload.
  */
-void GNSS_ParsePOSLLHData(GNSS_StateHandle *GNSS) {
+void GNSS_ParsePOSLLHData(GNSS_StateHandle *GNSS, const uint8_t *payload) {
+	GNSS_Fix fix = GNSS->fix;
 	//printf("Parsing POS LLH Data...\r\n");
 
-	//uint8_t res = checkUbxCrc(GNSS->uartWorkingBuffer, 100); // todo implement crc, need packet length
-	//if(!checkUbxCrc(GNSS->uartWorkingBuffer, 100)) { return; };
+	fix.lon = GNSS_LoadI32(&payload[POSLLH_LON]);
+	fix.lat = GNSS_LoadI32(&payload[POSLLH_LAT]);
+	fix.hMSL = GNSS_LoadI32(&payload[POSLLH_HMSL]);
+	GNSS_PublishFix(GNSS, &fix);
+}
+
+/*!
+ * Build a CFG-PRT frame from configUBX with another baud rate.
+ * @param frame Destination, sizeof(configUBX) bytes.
+ * @param baud Rate of the port.
+ */
+static void GNSS_BuildPort(uint8_t *frame, uint32_t baud) {
+	uint8_t payload[sizeof(configUBX) - 4];
+
+	for (uint8_t i = 0; i < sizeof(payload); i++) {
+		payload[i] = configUBX[2 + i];
+	}
+	// class, id, length, then baudRate at payload offset 8
+	payload[12] = (uint8_t)(baud);
+	payload[13] = (uint8_t)(baud >> 8);
+	payload[14] = (uint8_t)(baud >> 16);
+	payload[15] = (uint8_t)(baud >> 24);
+	buildUbxPacket(frame, payload, sizeof(payload));
+}
+
+static uint8_t GNSS_PortFast[sizeof(configUBX)];
+static uint8_t GNSS_PortDefault[sizeof(configUBX)];
+
+/*!
+ * Queue a CFG-PRT that moves the link to another rate.
+ * USART2 follows as soon as the receiver acknowledged or the request timed
+ * out, the acknowledge is often lost in the switch.
+ */
+static uint8_t GNSS_SubmitPort(GNSS_StateHandle *GNSS, const uint8_t *frame, uint32_t baud,
+		void (*done)(GNSS_StateHandle *GNSS, uint8_t status)) {
+	uint32_t primask = __get_PRIMASK();
+	uint8_t res;
+
+	__disable_irq();
+	res = GNSS_Submit(GNSS, frame, sizeof(configUBX), done);
+	if (res == GNSS_OK) {
+		GNSS->queue[(GNSS->qHead + GNSS->qCount - 1) % GNSS_QUEUE_LEN].baud = baud;
+	}
+	__set_PRIMASK(primask);
+	return res;
+}
+
+/*
+ * Configuration steps after the basic setup, each one queued from the done
+ * callback of the last. A step that finds the queue full is left in retry
+ * for GNSS_Tick. The polls run before periodic NAV-PVT is on, so
+ * pvtLatencyUs never times a pushed solution.
+ */
+static void GNSS_BaudSlowPolled(GNSS_StateHandle *GNSS, uint8_t status);
+static void GNSS_BaudPortSent(GNSS_StateHandle *GNSS, uint8_t status);
+static void GNSS_BaudFastPolled(GNSS_StateHandle *GNSS, uint8_t status);
+static void GNSS_BaudFallback(GNSS_StateHandle *GNSS, uint8_t status);
+static void GNSS_PVTPeriodicDone(GNSS_StateHandle *GNSS, uint8_t status);
+
+static void GNSS_StepPollSlow(GNSS_StateHandle *GNSS) {
+	if (GNSS_Submit(GNSS, getPVTData, sizeof(getPVTData), GNSS_BaudSlowPolled) != GNSS_OK) {
+		GNSS->retry = GNSS_StepPollSlow;
+	}
+}
 
-	for (int var = 0; var < 4; ++var) {
-		iLong.bytes[var] = GNSS->uartWorkingBuffer[var + 10];
+static void GNSS_StepPortFast(GNSS_StateHandle *GNSS) {
+	if (GNSS_SubmitPort(GNSS, GNSS_PortFast, GNSS_BAUD_FAST, GNSS_BaudPortSent) != GNSS_OK) {
+		GNSS->retry = GNSS_StepPortFast;
 	}
-	GNSS->lon = iLong.iLong;
-	GNSS->fLon=(float)iLong.iLong/10000000.0;
+}
 
-	for (int var = 0; var < 4; ++var) {
-		iLong.bytes[var] = GNSS->uartWorkingBuffer[var + 14];
+static void GNSS_StepPollFast(GNSS_StateHandle *GNSS) {
+	if (GNSS_Submit(GNSS, getPVTData, sizeof(getPVTData), GNSS_BaudFastPolled) != GNSS_OK) {
+		GNSS->retry = GNSS_StepPollFast;
 	}
-	GNSS->lat = iLong.iLong;
-	GNSS->fLat=(float)iLong.iLong/10000000.0;
+}
 
-	for (int var = 0; var < 4; ++var) {
-		iLong.bytes[var] = GNSS->uartWorkingBuffer[var + 18];
+static void GNSS_StepPortDefault(GNSS_StateHandle *GNSS) {
+	if (GNSS_SubmitPort(GNSS, GNSS_PortDefault, GNSS_BAUD_DEFAULT, GNSS_BaudFallback) != GNSS_OK) {
+		GNSS->retry = GNSS_StepPortDefault;
 	}
-	GNSS->height = iLong.iLong;
+}
 
-	for (int var = 0; var < 4; ++var) {
-		iLong.bytes[var] = GNSS->uartWorkingBuffer[var + 22];
+static void GNSS_StepPVTPeriodic(GNSS_StateHandle *GNSS) {
+	if (GNSS_Submit(GNSS, setPVTPeriodic, sizeof(setPVTPeriodic), GNSS_PVTPeriodicDone) != GNSS_OK) {
+		GNSS->retry = GNSS_StepPVTPeriodic;
 	}
-	GNSS->hMSL = iLong.iLong;
+}
 
-	for (int var = 0; var < 4; ++var) {
-		uLong.bytes[var] = GNSS->uartWorkingBuffer[var + 26];
+static void GNSS_BaudSlowPolled(GNSS_StateHandle *GNSS, uint8_t status) {
+	if (status == GNSS_OK) {
+		GNSS->pvtLatencyUs[0] = GNSS->latencyUs;
 	}
-	GNSS->hAcc = uLong.uLong;
+	GNSS_StepPortFast(GNSS);
+}
+
+static void GNSS_BaudPortSent(GNSS_StateHandle *GNSS, uint8_t status) {
+	// USART2 runs at the new rate now, confirm with a poll
+	GNSS_StepPollFast(GNSS);
+}
 
-	for (int var = 0; var < 4; ++var) {
-		uLong.bytes[var] = GNSS->uartWorkingBuffer[var + 30];
+static void GNSS_BaudFastPolled(GNSS_StateHandle *GNSS, uint8_t status) {
+	if (status == GNSS_OK) {
+		GNSS->pvtLatencyUs[1] = GNSS->latencyUs;
+		GNSS_StepPVTPeriodic(GNSS);
+		return;
 	}
-	GNSS->vAcc = uLong.uLong;
+	// no answer at the new rate: tell the receiver to go back, in case it
+	// switched, and return to the default rate in any case
+	GNSS_StepPortDefault(GNSS);
+}
+
+static void GNSS_BaudFallback(GNSS_StateHandle *GNSS, uint8_t status) {
+	// back at GNSS_BAUD_DEFAULT, the CFG-MSG acknowledge shows the receiver is still there
+	GNSS_StepPVTPeriodic(GNSS);
+}
+
+/*!
+ * Periodic NAV-PVT acknowledged, the receiver pushes fixes from now on.
+ */
+static void GNSS_PVTPeriodicDone(GNSS_StateHandle *GNSS, uint8_t status) {
+	GNSS->pvtPeriodic = (status == GNSS_OK);
 }
 
 /*!
  *  Sends the basic configuration: Activation of the UBX standard, change of NMEA version to 4.10 and turn on of the Galileo system.
+ *  Then sets the navigation rate (CFG-RATE) and raises the link to GNSS_BAUD_FAST: a NAV-PVT poll is
+ *  timed at the default rate, CFG-PRT is sent, USART2 switched and the poll repeated. Without an answer
+ *  both sides go back to GNSS_BAUD_DEFAULT. Last, periodic NAV-PVT output is turned on (CFG-MSG).
+ *  Queued, returns before the receiver has answered; the result shows up in baud and pvtLatencyUs.
  * @param GNSS Pointer to main GNSS structure.
  */
 void GNSS_LoadConfig(GNSS_StateHandle *GNSS) {
+	// CFG-RATE: measurement period, one solution per measurement, GPS time
+	static const uint8_t rate[] = { 0x06, 0x08, 0x06, 0x00,
+			(uint8_t)(GNSS_NAV_RATE_MS), (uint8_t)(GNSS_NAV_RATE_MS >> 8),
+			0x01, 0x00, 0x01, 0x00 };
+	static uint8_t setRate[sizeof(rate) + 4];
+
 	printf("Sending ubx config...\r\n");
-	GNSS->txDone = 0x00;
-	GNSS->rxDone = 0x00;
-	HAL_UART_Transmit_DMA(GNSS->huart, configUBX,
-			sizeof(configUBX) / sizeof(uint8_t));
-	HAL_UART_Receive_DMA(GNSS->huart, GNSS->uartWorkingBuffer, 10);
-	while((GNSS->txDone == 0x00) || (GNSS->rxDone == 0x00)) {};
+	GNSS_Submit(GNSS, configUBX, sizeof(configUBX), NULL);
 
 	printf("Sending NMEA410 config...\r\n");
-	GNSS->txDone = 0x00;
-	GNSS->rxDone = 0x00;
-	HAL_UART_Transmit_DMA(GNSS->huart, setNMEA410,
-			sizeof(setNMEA410) / sizeof(uint8_t));
-	HAL_UART_Receive_DMA(GNSS->huart, GNSS->uartWorkingBuffer, 10);
-	while((GNSS->txDone == 0x00) || (GNSS->rxDone == 0x00)) {};
+	GNSS_Submit(GNSS, setNMEA410, sizeof(setNMEA410), NULL);
 
 	printf("Sending GNSS config...\r\n");
-	GNSS->txDone = 0x00;
-	GNSS->rxDone = 0x00;
-	HAL_UART_Transmit_DMA(GNSS->huart, setGNSS,
-			sizeof(setGNSS) / sizeof(uint8_t));
-	HAL_UART_Receive_DMA(GNSS->huart, GNSS->uartWorkingBuffer, 10);
-	while((GNSS->txDone == 0x00) || (GNSS->rxDone == 0x00)) {};
+	GNSS_Submit(GNSS, setGNSS, sizeof(setGNSS), NULL);
+
+	printf("Sending NAV-PVT %d ms config...\r\n", GNSS_NAV_RATE_MS);
+	buildUbxPacket(setRate, (uint8_t *)rate, sizeof(rate));
+	GNSS_Submit(GNSS, setRate, sizeof(setRate), NULL);
+	// quiet the link for the timed polls, the receiver may still push from before a reset
+	GNSS_Submit(GNSS, setPVTOff, sizeof(setPVTOff), NULL);
+
+	printf("Negotiating %lu baud...\r\n", (unsigned long)GNSS_BAUD_FAST);
+	GNSS_BuildPort(GNSS_PortFast, GNSS_BAUD_FAST);
+	GNSS_BuildPort(GNSS_PortDefault, GNSS_BAUD_DEFAULT);
+	GNSS_StepPollSlow(GNSS);
 }
 
 
@@ -0,0 +1,296 @@
+/**
+  ******************************************************************************
+  * @file    afsk.c
+  * @brief   This file contains the timer + DMA driven AFSK waveform generator
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  * Every TIM15 update event requests a DMA transfer of one 32 bit word from
+  * afsk_dma_buf into GPIOA->BSRR, setting or resetting Si4063 GPIO3. The words
+  * are precomputed from the pre-encoded AX.25 bitstream with the same NCO as
+  * processAprsTick, so the edges only depend on the timer. The CPU is only
+  * needed for a refill every AFSK_DMA_HALF_LEN samples.
+  *
+  * The sine engine uses the same NCO, but instead of a GPIO level every sample
+  * writes one entry of a sine table into the Si4063 MODEM_FREQ_OFFSET property
+  * from the TIM15 interrupt. afsk_sine_overruns counts samples whose SPI write
+  * did not finish before the next timer update, or was skipped because the
+  * bus was in use; the interrupt never waits for SPI1. afsk_sine_max_cycles
+  * is the longest sample measured with the cycle counter.
+  ******************************************************************************
+  */
+
+#include "afsk.h"
+#include "tim.h"
+#include "gpio.h"
+#include "spi.h"
+
+extern uint8_t aprs_stream[];
+extern uint16_t aprs_stream_bits;
+
+static uint32_t afsk_dma_buf[AFSK_DMA_BUF_LEN];
+
+static volatile uint8_t afsk_busy = 0;
+static uint8_t afsk_flush;
+static uint16_t afsk_bit_idx;
+static uint8_t afsk_bit;
+static uint32_t afsk_phase;
+static uint32_t afsk_baud_phase;
+static volatile uint16_t afsk_overruns;
+static volatile uint32_t afsk_max_cycles;
+
+/* one period of sin(x), Q15 */
+static const int16_t afsk_sine_table[AFSK_SINE_TABLE_LEN] = {
+	     0,   3212,   6393,   9512,  12539,  15446,  18204,  20787,
+	 23170,  25329,  27245,  28898,  30273,  31356,  32137,  32609,
+	 32767,  32609,  32137,  31356,  30273,  28898,  27245,  25329,
+	 23170,  20787,  18204,  15446,  12539,   9512,   6393,   3212,
+	     0,  -3212,  -6393,  -9512, -12539, -15446, -18204, -20787,
+	-23170, -25329, -27245, -28898, -30273, -31356, -32137, -32609,
+	-32767, -32609, -32137, -31356, -30273, -28898, -27245, -25329,
+	-23170, -20787, -18204, -15446, -12539,  -9512,  -6393,  -3212,
+};
+
+/*
+ * afsk_fill
+ *
+ * renders the next AFSK_DMA_HALF_LEN samples of the bitstream into the buffer.
+ * once the bitstream is exhausted, the output level is held and the transfer
+ * is stopped after the last samples have been played.
+ */
+static void afsk_fill(uint32_t *buf) {
+	uint16_t i;
+	uint32_t prev;
+
+	for (i = 0; i < AFSK_DMA_HALF_LEN; i++) {
+		prev = afsk_baud_phase;
+		afsk_baud_phase += APRS_BAUD_STEP;
+		if (afsk_baud_phase < prev) {
+			if (afsk_bit_idx < aprs_stream_bits) {
+				afsk_bit = (aprs_stream[afsk_bit_idx >> 3] >> (afsk_bit_idx & 0x07)) & 0x01;
+				afsk_bit_idx++;
+			} else if (!afsk_flush) {
+				/* this half and the one currently playing still have to go out */
+				afsk_flush = 2;
+			}
+		}
+
+		if (!afsk_flush) {
+			afsk_phase += (afsk_bit == APRS_SPACE) ? APRS_SPACE_STEP : APRS_MARK_STEP;
+		}
+
+		buf[i] = (afsk_phase & APRS_NCO_MSB) ? AFSK_BSRR_HIGH : AFSK_BSRR_LOW;
+	}
+}
+
+/*
+ * afsk_refill
+ *
+ * called from the DMA interrupt once a buffer half has been played
+ */
+static void afsk_refill(uint32_t *buf) {
+	if (afsk_flush && --afsk_flush == 0) {
+		afsk_dma_stop();
+		return;
+	}
+	afsk_fill(buf);
+}
+
+static void afsk_dma_half_cplt(DMA_HandleTypeDef *hdma) {
+	afsk_refill(&afsk_dma_buf[0]);
+}
+
+static void afsk_dma_cplt(DMA_HandleTypeDef *hdma) {
+	afsk_refill(&afsk_dma_buf[AFSK_DMA_HALF_LEN]);
+}
+
+/*
+ * afsk_dma_start
+ *
+ * starts playing the pre-encoded bitstream (aprs_stream) on Si4063 GPIO3.
+ * TIM15 is switched from the tick interrupt to update DMA requests.
+ * returns immediately, use afsk_dma_busy to wait for the end of the frame.
+ */
+void afsk_dma_start(void) {
+	stopAprsTickTimer();
+
+	afsk_flush = 0;
+	afsk_bit_idx = 0;
+	afsk_bit = APRS_MARK;
+	afsk_phase = 0;
+	afsk_baud_phase = (uint32_t)0 - APRS_BAUD_STEP;	/* first sample loads the first bit */
+	afsk_fill(&afsk_dma_buf[0]);
+	afsk_fill(&afsk_dma_buf[AFSK_DMA_HALF_LEN]);
+
+	afsk_busy = 1;
+	hdma_tim15_up.XferHalfCpltCallback = afsk_dma_half_cplt;
+	hdma_tim15_up.XferCpltCallback = afsk_dma_cplt;
+	if (HAL_DMA_Start_IT(&hdma_tim15_up, (uint32_t)afsk_dma_buf,
+			(uint32_t)&oSpiGPIO3_GPIO_Port->BSRR, AFSK_DMA_BUF_LEN) != HAL_OK) {
+		afsk_busy = 0;
+		Error_Handler();
+	}
+	__HAL_TIM_SET_COUNTER(&htim15, 0);
+	__HAL_TIM_ENABLE_DMA(&htim15, TIM_DMA_UPDATE);
+	HAL_TIM_Base_Start(&htim15);
+}
+
+/*
+ * afsk_dma_stop
+ *
+ * stops the timer and the DMA transfer and leaves GPIO3 low
+ */
+void afsk_dma_stop(void) {
+	HAL_TIM_Base_Stop(&htim15);
+	__HAL_TIM_DISABLE_DMA(&htim15, TIM_DMA_UPDATE);
+	HAL_DMA_Abort(&hdma_tim15_up);
+	deassertSiGPIO3();
+	afsk_busy = 0;
+}
+
+/*
+ * afsk_dma_busy
+ *
+ * returns:	1 while a frame is being played, 0 otherwise
+ */
+uint8_t afsk_dma_busy(void) {
+	return afsk_busy;
+}
+
+/*
+ * afsk_sine_start
+ *
+ * starts playing the pre-encoded bitstream (aprs_stream) as sine AFSK through
+ * MODEM_FREQ_OFFSET. MODEM_FREQ_DEV has to be 0 and GPIO3 is held low, so the
+ * offset register is the only source of deviation.
+ * returns immediately, use afsk_sine_busy to wait for the end of the frame.
+ */
+void afsk_sine_start(void) {
+	stopAprsTickTimer();
+	deassertSiGPIO3();
+
+	afsk_bit_idx = 0;
+	afsk_bit = APRS_MARK;
+	afsk_phase = 0;
+	afsk_baud_phase = (uint32_t)0 - AFSK_SINE_BAUD_STEP;	/* first sample loads the first bit */
+	afsk_overruns = 0;
+	afsk_max_cycles = 0;
+
+	spi_xfer_wait();
+	spi_set_prescaler(AFSK_SINE_SPI_PRESCALER);
+	__HAL_TIM_SET_AUTORELOAD(&htim15, AFSK_SINE_TICK_PERIOD);
+	__HAL_TIM_SET_COUNTER(&htim15, 0);
+	afsk_busy = 1;
+	startAprsTickTimer();
+}
+
+/*
+ * afsk_sine_stop
+ *
+ * called from the last sample, restores the timer. the bus is left alone,
+ * see afsk_sine_finish.
+ */
+static void afsk_sine_stop(void) {
+	stopAprsTickTimer();
+	__HAL_TIM_SET_AUTORELOAD(&htim15, APRS_TICK_PERIOD);
+	afsk_busy = 0;
+}
+
+/*
+ * afsk_sine_finish
+ *
+ * called once afsk_sine_busy returned 0, restores the SPI clock and the
+ * carrier. waits for the bus, which the sample interrupt must not do.
+ */
+void afsk_sine_finish(void) {
+	spi_xfer_wait();
+	spi_set_prescaler(hspi1.Init.BaudRatePrescaler);
+	si4060_set_property_16(PROP_MODEM, MODEM_FREQ_OFFSET, 0);
+}
+
+/*
+ * afsk_sine_tick
+ *
+ * called on every TIM15 update while the sine engine is running.
+ * advances the NCOs and writes the next frequency offset.
+ */
+void afsk_sine_tick(void) {
+	uint32_t start = getCycleCount();
+	uint32_t prev, cycles;
+	int16_t offset;
+
+	if (!afsk_busy) {
+		return;
+	}
+
+	prev = afsk_baud_phase;
+	afsk_baud_phase += AFSK_SINE_BAUD_STEP;
+	if (afsk_baud_phase < prev) {
+		if (afsk_bit_idx >= aprs_stream_bits) {
+			afsk_sine_stop();
+			return;
+		}
+		afsk_bit = (aprs_stream[afsk_bit_idx >> 3] >> (afsk_bit_idx & 0x07)) & 0x01;
+		afsk_bit_idx++;
+	}
+
+	afsk_phase += (afsk_bit == APRS_SPACE) ? AFSK_SINE_SPACE_STEP : AFSK_SINE_MARK_STEP;
+	offset = (int16_t)(((int32_t)afsk_sine_table[afsk_phase >> (32 - AFSK_SINE_TABLE_BITS)]
+			* AFSK_SINE_DEV) >> 15);
+	/* the next sample is already due, the write did not fit, or the bus
+	 * was taken and this sample is dropped */
+	if (si4060_set_offset((uint16_t)offset) != SI_OK
+			|| __HAL_TIM_GET_FLAG(&htim15, TIM_FLAG_UPDATE)) {
+		afsk_overruns++;
+	}
+
+	cycles = getCycleCount() - start;
+	if (cycles > afsk_max_cycles) {
+		afsk_max_cycles = cycles;
+	}
+}
+
+/*
+ * afsk_sine_busy
+ *
+ * returns:	1 while a frame is being played, 0 otherwise
+ */
+uint8_t afsk_sine_busy(void) {
+	return afsk_busy;
+}
+
+/*
+ * afsk_sine_overruns
+ *
+ * returns:	number of samples of the last frame that missed their deadline
+ */
+uint16_t afsk_sine_overruns(void) {
+	return afsk_overruns;
+}
+
+/*
+ * afsk_sine_max_cycles
+ *
+ * returns:	longest afsk_sine_tick of the last frame in core clock cycles,
+ * 			without interrupt entry and HAL_TIM_IRQHandler
+ */
+uint32_t afsk_sine_max_cycles(void) {
+	return afsk_max_cycles;
+}
@@ -42,93 +42,276 @@
 
 #include "aprs.h"
 #include <inttypes.h>
+#include <stdio.h>
 #include "GNSS.h"
 #include "gps.h"
 #include "si4063.h"
 #include "tim.h"
 #include "string.h"
-#include <math.h>
 #include "led.h"
+#include "fcs.h"
+#include "gpio.h"
+#include "afsk.h"
+#include "ax25_decode.h"
 
 /*
  * the APRS data buffer
- * contains ASCII data
+ * contains ASCII data, only change it through aprs_buf_update so the FCS
+ * checkpoints stay valid
  */
 char aprs_buf[APRS_BUF_LEN] = "/ddhhmmz/xxxxyyyyOaa1|ss001122|";
 // KC0TWY-5>APDR16,TCPIP*,qAC,T2LAUSITZ:=3858.33N/09439.08W>166/000/A=000973 https://aprsdroid.org/
 //char aprs_buf[] = "=3858.33N/09439.08W>189/000/A=000972 https://aprsdroid.org/";
 
+/*
+ * the pre-encoded AX.25 bitstream
+ * flags, header, buffer and FCS, already bit stuffed and NRZI coded, LSB first
+ */
+uint8_t aprs_stream[APRS_STREAM_LEN];
+uint16_t aprs_stream_bits = 0;
+
 extern volatile uint16_t aprs_bit;
 extern volatile uint16_t aprs_tick;
 extern volatile uint16_t aprs_baud_tick;
 extern volatile uint8_t ppsLockStatus;
 
-const unsigned char aprs_header[APRS_HEADER_LEN] = {
-	'A'*2, 'P'*2, 'R'*2, 'S'*2, ' '*2, ' '*2, SSID_RESC + (DST_SSID << 1),
-	'K'*2, 'E'*2, '0'*2, 'P'*2, 'R'*2, 'Y'*2, SSID_RESC + (SRC_SSID << 1),
-	'W'*2, 'I'*2, 'D'*2, 'E'*2, '1'*2, ' '*2, SSID_RESC + (WIDE_SSID << 1) + HEADER_END,
-	CONTROL_UI, PID_NONE};
+/*
+ * the AX.25 header (address field, control and PID), see aprs_set_header
+ * aprs_header_crc is the FCS register after running over the header
+ */
+unsigned char aprs_header[APRS_HEADER_MAX_LEN];
+uint8_t aprs_header_len = 0;
+static uint16_t aprs_header_crc;
 
-enum aprs_states {SM_INIT, SFLAG, AX25_HEADER, AX25_DATA, AX25_FCS1, AX25_FCS2, EFLAG};
+/*
+ * FCS checkpoints of aprs_buf
+ * aprs_buf_cp[k] is the FCS register before aprs_buf[aprs_cp_offset[k]], aprs_buf_crc
+ * the register after the whole buffer. aprs_buf_dirty is the offset of the first byte
+ * changed since the last calculation (APRS_BUF_LEN: all checkpoints valid).
+ */
+static const uint8_t aprs_cp_offset[] = {
+	0, APRS_TIME_START, APRS_LAT_START, APRS_LON_START, APRS_ALT_START,
+	APRS_SEQ_START, APRS_TEMP_START, APRS_VOLT_START, APRS_VSOL_START};
+#define APRS_CP_COUNT	((uint8_t)(sizeof(aprs_cp_offset) / sizeof(aprs_cp_offset[0])))
+static uint16_t aprs_buf_cp[APRS_CP_COUNT];
+static uint16_t aprs_buf_crc;
+static uint8_t aprs_buf_dirty = 0;
+
+/*
+ * info field format of the frame prepared last, and the Mic-E frame
+ */
+static uint8_t aprs_format = APRS_FMT_COMPRESSED;
+static APRS_Frame aprs_mice;
+
+/*
+ * frame queue, frames waiting for the next burst
+ */
+static APRS_Frame aprs_queue[APRS_QUEUE_LEN];
+static uint8_t aprs_queued = 0;
+
+/*
+ * frames of the stream being encoded
+ */
+static APRS_Frame aprs_single;
+static const APRS_Frame *aprs_tx[APRS_QUEUE_LEN];
+static uint8_t aprs_tx_count = 0;
+static uint8_t aprs_tx_frame = 0;
+
+enum aprs_states {SM_INIT, SFLAG, AX25_HEADER, AX25_DATA, AX25_FCS1, AX25_FCS2, IFLAG, EFLAG};
 volatile uint16_t aprs_state = SM_INIT;
-volatile uint16_t fcs = 0;
 volatile uint8_t bitcnt = 8;
 volatile uint8_t onecnt = 0;
 volatile uint8_t finished = 0;
 volatile uint8_t stuffing = 0;
 
-uint16_t rev16(uint16_t x) {
-  return (x << 8) | (x >>8);
+/*
+ * aprs_encode_addr
+ *
+ * encodes one address subfield: callsign padded with spaces, shifted left by
+ * one, followed by the SSID byte.
+ *
+ * returns: 0 on success, 1 if the callsign or SSID is invalid
+ */
+static uint8_t aprs_encode_addr(unsigned char *addr, const char *call, uint8_t ssid, uint8_t last) {
+	uint8_t i;
+
+	if (call == 0 || ssid > 15) {
+		return 1;
+	}
+	for (i = 0; i < APRS_CALL_LEN && call[i]; i++) {
+		if (!((call[i] >= 'A' && call[i] <= 'Z') || (call[i] >= '0' && call[i] <= '9'))) {
+			return 1;
+		}
+		addr[i] = call[i] << 1;
+	}
+	if (i == 0 || call[i]) {
+		return 1;
+	}
+	for (; i < APRS_CALL_LEN; i++) {
+		addr[i] = ' ' << 1;
+	}
+	addr[APRS_CALL_LEN] = SSID_RESC + (ssid << 1) + (last ? HEADER_END : 0);
+	return 0;
+}
+
+/*
+ * aprs_set_header
+ *
+ * builds the AX.25 header from callsigns and SSIDs and caches the FCS register
+ * after it, so calculate_fcs only has to run over the info field. the header is
+ * left unchanged on invalid input. aprs_encode_frame has to be called afterwards.
+ *
+ * dst, dst_ssid:	destination (tocall) and SSID
+ * src, src_ssid:	source callsign and SSID
+ * path, path_ssid:	digipeater path and SSIDs, path_count entries (0 .. APRS_MAX_PATH)
+ *
+ * returns: 0 on success, 1 on an invalid callsign, SSID or path
+ */
+uint8_t aprs_set_header(const char *dst, uint8_t dst_ssid, const char *src, uint8_t src_ssid,
+		const char * const *path, const uint8_t *path_ssid, uint8_t path_count) {
+	unsigned char header[APRS_HEADER_MAX_LEN];
+	uint8_t len, i;
+
+	if (path_count > APRS_MAX_PATH) {
+		return 1;
+	}
+	if (aprs_encode_addr(&header[0], dst, dst_ssid, 0) ||
+			aprs_encode_addr(&header[APRS_ADDR_LEN], src, src_ssid, path_count == 0)) {
+		return 1;
+	}
+	len = 2 * APRS_ADDR_LEN;
+	for (i = 0; i < path_count; i++) {
+		if (aprs_encode_addr(&header[len], path[i], path_ssid[i], i == path_count - 1)) {
+			return 1;
+		}
+		len += APRS_ADDR_LEN;
+	}
+	header[len++] = CONTROL_UI;
+	header[len++] = PID_NONE;
+
+	for (i = 0; i < len; i++) {
+		aprs_header[i] = header[i];
+	}
+	aprs_header_len = len;
+	aprs_header_crc = fcs_update(FCS_INIT, aprs_header, aprs_header_len);
+	/* all aprs_buf checkpoints continue from the header */
+	aprs_buf_dirty = 0;
+	return 0;
 }
 
-static uint16_t calc_aprscrc (uint8_t crcStart, uint8_t *frame, uint8_t frame_len)
-{
-
-    uint8_t i, j;
-    // Preload the CRC register with ones
-    //uint16_t crc = 0xffff;
-    uint16_t crc = crcStart;
-
-
-    // Iterate over every octet in the frame
-    for (i = 0; i < frame_len; i++)
-    {
-        // Iterate over every bit, LSb first
-        for (j = 0; j < 8; j++)
-        {
-            uint8_t bit = (frame[i] >> j) & 0x01;
-
-            // Divide by a bit - reversed 0x1021
-            if ((crc & 0x0001) != bit)
-            {
-                crc = (crc >> 1) ^ 0x8408;
-            }
-            else
-            {
-                crc = crc >> 1;
-            }
-        }
-    }
-
-
-    return crc;
+/*
+ * aprs_set_default_header
+ *
+ * APRS_DST_CALL-DST_SSID > APRS_SRC_CALL-SRC_SSID, APRS_PATH_CALL-WIDE_SSID
+ */
+static void aprs_set_default_header(void) {
+	static const char * const path[] = {APRS_PATH_CALL};
+	static const uint8_t path_ssid[] = {WIDE_SSID};
+
+	aprs_set_header(APRS_DST_CALL, DST_SSID, APRS_SRC_CALL, SRC_SSID, path, path_ssid, 1);
 }
 
-void calculate_fcs(void) {
-	// calculate crc of header with initial value of 0xFFFF
-	uint16_t crcval1 = 0;
-	crcval1 = calc_aprscrc(0xFFFF, aprs_header, APRS_HEADER_LEN);
+/*
+ * aprs_frame_fcs
+ *
+ * returns: the FCS of a frame with the current header
+ */
+static uint16_t aprs_frame_fcs(const APRS_Frame *frame) {
+	uint16_t crc;
+
+	if (aprs_header_len == 0) {
+		aprs_set_default_header();
+	}
 
-	// pass header calculation back into crc calc to process buffer
-	uint16_t crcval2 = 0;
-	crcval2 = calc_aprscrc(crcval1, aprs_buf, APRS_BUF_LEN);
+	if (frame->own_dst) {
+		crc = fcs_update(FCS_INIT, frame->dst, APRS_ADDR_LEN);
+		crc = fcs_update(crc, &aprs_header[APRS_ADDR_LEN], aprs_header_len - APRS_ADDR_LEN);
+	} else {
+		// continue from the cached crc of the header
+		crc = aprs_header_crc;
+	}
+	crc = fcs_update(crc, (const uint8_t *)frame->info, frame->info_len);
 
 	// Take the one's compliment of the calculated CRC
-	crcval2 = crcval2 ^ 0xffff;
+	// sent low byte first (AX25_FCS1), the FCS ends up MSb first on air
+	return crc ^ FCS_XOROUT;
+}
+
+/*
+ * aprs_buf_update
+ *
+ * copies a field into aprs_buf, remembering the first byte that changed
+ */
+static void aprs_buf_update(uint8_t start, const char *val, uint8_t len) {
+	uint8_t i;
+
+	for (i = 0; i < len; i++) {
+		if (aprs_buf[start + i] != val[i]) {
+			aprs_buf[start + i] = val[i];
+			if (start + i < aprs_buf_dirty) {
+				aprs_buf_dirty = start + i;
+			}
+		}
+	}
+}
+
+/*
+ * aprs_buf_fcs
+ *
+ * returns the FCS of a frame with the current header and aprs_buf. resumes
+ * from the last checkpoint before the first changed byte, e.g. a new sequence
+ * number only re-hashes the telemetry part.
+ */
+static uint16_t aprs_buf_fcs(void) {
+	uint8_t k;
+	uint8_t end;
+	uint16_t crc;
+
+	if (aprs_header_len == 0) {
+		aprs_set_default_header();
+	}
+
+	if (aprs_buf_dirty < APRS_BUF_LEN) {
+		k = APRS_CP_COUNT - 1;
+		while (aprs_cp_offset[k] > aprs_buf_dirty) {
+			k--;
+		}
+		crc = (k == 0) ? aprs_header_crc : aprs_buf_cp[k];
+		for (; k < APRS_CP_COUNT; k++) {
+			aprs_buf_cp[k] = crc;
+			end = (k + 1 < APRS_CP_COUNT) ? aprs_cp_offset[k + 1] : APRS_BUF_LEN;
+			crc = fcs_update(crc, (const uint8_t *)&aprs_buf[aprs_cp_offset[k]], end - aprs_cp_offset[k]);
+		}
+		aprs_buf_crc = crc;
+		aprs_buf_dirty = APRS_BUF_LEN;
+	}
+	return aprs_buf_crc ^ FCS_XOROUT;
+}
+
+/*
+ * aprs_current_frame
+ *
+ * copies the frame prepared last (aprs_buf or Mic-E) and calculates its FCS
+ */
+static void aprs_current_frame(APRS_Frame *frame) {
+	uint8_t i;
 
-	// bytes are swapped, so reverse
-	fcs = rev16(crcval2);
+	if (aprs_format == APRS_FMT_MICE) {
+		*frame = aprs_mice;
+	} else {
+		for (i = 0; i < APRS_BUF_LEN; i++) {
+			frame->info[i] = aprs_buf[i];
+		}
+		frame->info_len = APRS_BUF_LEN;
+		frame->own_dst = 0;
+		frame->fcs = aprs_buf_fcs();
+		return;
+	}
+	frame->fcs = aprs_frame_fcs(frame);
+}
 
+void calculate_fcs(void) {
+	aprs_current_frame(&aprs_single);
 }
 
 /*
@@ -154,6 +337,92 @@ void base91_encode_latlon(char *buf, uint32_t value) {
     buf[3] = 33 + (value % 91);
 }
 
+/*
+ * log2(1 + i / 32) in Q16, for log2_q16
+ */
+static const uint32_t log2_frac_table[33] = {
+	    0,  2909,  5732,  8473, 11136, 13727, 16248, 18704,
+	21098, 23433, 25711, 27936, 30109, 32234, 34312, 36346,
+	38336, 40286, 42196, 44068, 45904, 47705, 49472, 51207,
+	52911, 54584, 56229, 57845, 59434, 60997, 62534, 64047,
+	65536};
+
+/*
+ * log2_q16
+ *
+ * integer log2 in Q16. the integer part comes from the bit position of the MSB,
+ * the fraction from a 32 segment table with linear interpolation (error < 1e-4).
+ *
+ * x:	value > 0
+ */
+static uint32_t log2_q16(uint32_t x) {
+	uint8_t msb = 31 - __builtin_clz(x);
+	uint32_t m = x << (31 - msb);	/* 1.31 fixed point mantissa */
+	uint8_t i = (m >> 26) & 0x1f;
+	uint32_t rem = (m >> 10) & 0xffff;
+
+	return ((uint32_t)msb << 16) + log2_frac_table[i]
+			+ (((log2_frac_table[i + 1] - log2_frac_table[i]) * rem) >> 16);
+}
+
+/*
+ * aprs_compress_lat
+ *
+ * lat:	latitude in 1e-7 deg
+ *
+ * returns: 380926 * (90 - lat) for base91_encode_latlon
+ */
+uint32_t aprs_compress_lat(int32_t lat) {
+	if (lat > 900000000L) {
+		lat = 900000000L;
+	} else if (lat < -900000000L) {
+		lat = -900000000L;
+	}
+	return ((uint64_t)(uint32_t)(900000000L - lat) * APRS_LAT_SCALE_Q32) >> 32;
+}
+
+/*
+ * aprs_compress_lon
+ *
+ * lon:	longitude in 1e-7 deg
+ *
+ * returns: 190463 * (180 + lon) for base91_encode_latlon
+ */
+uint32_t aprs_compress_lon(int32_t lon) {
+	if (lon > 1800000000L) {
+		lon = 1800000000L;
+	} else if (lon < -1800000000L) {
+		lon = -1800000000L;
+	}
+	return ((uint64_t)(uint32_t)((uint32_t)lon + 1800000000UL) * APRS_LON_SCALE_Q32) >> 32;
+}
+
+/*
+ * aprs_compress_alt
+ *
+ * hmsl:	height above mean sea level in mm
+ *
+ * returns: log(alt in ft) / log(1.002) for base91_encode_tlm, 0 below 1 ft
+ */
+uint16_t aprs_compress_alt(int32_t hmsl) {
+	uint32_t ft_x12500;
+	uint32_t lg;
+
+	/* ft = mm * 3.28 / 1000 = mm * 41 / 12500, keep the factor 12500 inside the log */
+	if (hmsl <= 0) {
+		return 0;
+	}
+	if (hmsl > APRS_ALT_MAX_MM) {
+		hmsl = APRS_ALT_MAX_MM;
+	}
+	ft_x12500 = (uint32_t)hmsl * 41;
+	lg = log2_q16(ft_x12500);
+	if (lg <= APRS_LOG2_12500_Q16) {
+		return 0;
+	}
+	return ((uint64_t)(lg - APRS_LOG2_12500_Q16) * APRS_ALT_SCALE_Q16) >> 32;
+}
+
 /*
  * aprs_prepare_buffer
  *
@@ -169,24 +438,30 @@ void aprs_prepare_buffer(GNSS_StateHandle *GNSS, uint8_t backlog_fix) {
 	int16_t temp_aprs = 0;
 	uint16_t seq_tmp;
 	static uint16_t aprs_seqnum = 0;
+	char field[APRS_TIME_LEN];
+	GNSS_Fix fix;
 
 	if (!ppsLockStatus)
 		return;
 
-	i16toa(22, 2, &aprs_buf[APRS_TIME_START]);
-	i16toa(18, 2, &aprs_buf[APRS_TIME_START + 2]);
-	i16toa(13, 2, &aprs_buf[APRS_TIME_START + 4]);
+	/* consistent snapshot, the UART callback may publish a new fix any time */
+	GNSS_GetFix(GNSS, &fix);
+
+	aprs_format = APRS_FMT_COMPRESSED;
+	i16toa(22, 2, &field[0]);
+	i16toa(18, 2, &field[2]);
+	i16toa(13, 2, &field[4]);
+	aprs_buf_update(APRS_TIME_START, field, APRS_TIME_LEN);
 	//i16toa(fix->day, 2, &aprs_buf[APRS_TIME_START]); 			// todo link to gps info
 	//i16toa(fix->hour, 2, &aprs_buf[APRS_TIME_START + 2]);		// todo link to gps info
 	//i16toa(fix->min, 2, &aprs_buf[APRS_TIME_START + 4]);		// todo link to gps info
 
-	//base91_encode_latlon(&aprs_buf[APRS_LAT_START], 380926.0f * (90.0f - (float)fix->lat/10000000.0f)); 	// todo link to gps info
-	//base91_encode_latlon(&aprs_buf[APRS_LON_START], 190463.0f * (180.0f + (float)fix->lon/10000000.0f));	// todo link to gps info
-	//base91_encode_tlm(&aprs_buf[APRS_ALT_START], logf((float)fix->alt * 3.28f)/logf(1.002f));				// todo link to gps info
-
-	base91_encode_latlon(&aprs_buf[APRS_LAT_START], 380926.0f * (90.0f - (float)38.9987994f/10000000.0f));
-	base91_encode_latlon(&aprs_buf[APRS_LON_START], 190463.0f * (180.0f + (float)-94.6819493557f/10000000.0f));
-	base91_encode_tlm(&aprs_buf[APRS_ALT_START], logf((float)100.0f * 3.28f)/logf(1.002f));
+	base91_encode_latlon(field, aprs_compress_lat(fix.lat));
+	aprs_buf_update(APRS_LAT_START, field, APRS_LAT_LEN);
+	base91_encode_latlon(field, aprs_compress_lon(fix.lon));
+	aprs_buf_update(APRS_LON_START, field, APRS_LON_LEN);
+	base91_encode_tlm(field, aprs_compress_alt(fix.hMSL));
+	aprs_buf_update(APRS_ALT_START, field, APRS_ALT_LEN);
 
 	if (backlog_fix) {
 		seq_tmp = 0;
@@ -204,12 +479,46 @@ void aprs_prepare_buffer(GNSS_StateHandle *GNSS, uint8_t backlog_fix) {
 
 	temp_aprs = 32 + APRS_TLM_TEMP_OFFSET;
 
-	base91_encode_tlm(&aprs_buf[APRS_SEQ_START], seq_tmp);
-	base91_encode_tlm(&aprs_buf[APRS_TEMP_START], (uint16_t)temp_aprs);
-	base91_encode_tlm(&aprs_buf[APRS_VOLT_START], 3000);
-	base91_encode_tlm(&aprs_buf[APRS_VSOL_START], 3100);
+	base91_encode_tlm(field, seq_tmp);
+	aprs_buf_update(APRS_SEQ_START, field, APRS_SEQ_LEN);
+	base91_encode_tlm(field, (uint16_t)temp_aprs);
+	aprs_buf_update(APRS_TEMP_START, field, APRS_TEMP_LEN);
+	base91_encode_tlm(field, 3000);
+	aprs_buf_update(APRS_VOLT_START, field, APRS_VOLT_LEN);
+	base91_encode_tlm(field, 3100);
+	aprs_buf_update(APRS_VSOL_START, field, APRS_VSOL_LEN);
 
-	calculate_fcs();
+	aprs_encode_frame();
+}
+
+/*
+ * aprs_prepare_mice
+ *
+ * prepares a Mic-E position report from the given fix. the next frame encoded or
+ * queued uses it instead of aprs_buf, until aprs_prepare_buffer is called again.
+ *
+ * returns: 0 on success, 1 without a fix or if the destination address is
+ * 			invalid, the frame prepared last is unchanged then
+ */
+uint8_t aprs_prepare_mice(GNSS_StateHandle *GNSS) {
+	char dst_call[MICE_DST_LEN + 1];
+	APRS_Frame frame;
+	GNSS_Fix fix;
+
+	if (!ppsLockStatus)
+		return 1;
+
+	GNSS_GetFix(GNSS, &fix);
+	frame.info_len = mice_encode(&fix, dst_call, frame.info);
+	if (aprs_encode_addr(frame.dst, dst_call, DST_SSID, 0)) {
+		return 1;
+	}
+	frame.own_dst = 1;
+	aprs_mice = frame;
+	aprs_format = APRS_FMT_MICE;
+
+	aprs_encode_frame();
+	return 0;
 }
 
 /*
@@ -243,6 +552,7 @@ uint8_t get_next_byte(void) {
 		case SM_INIT:
 			stuffing = 0;
 			aprs_state = SFLAG;
+			aprs_tx_frame = 0;
 			i = 0;
 		case SFLAG:
 			retval = AX25_FLAG;
@@ -253,26 +563,42 @@ uint8_t get_next_byte(void) {
 			break;
 		case AX25_HEADER:
 			stuffing = 1;
-			retval = aprs_header[i];
-			if (++i >= APRS_HEADER_LEN) {
+			if (i < APRS_ADDR_LEN && aprs_tx[aprs_tx_frame]->own_dst) {
+				retval = aprs_tx[aprs_tx_frame]->dst[i];
+			} else {
+				retval = aprs_header[i];
+			}
+			if (++i >= aprs_header_len) {
 				aprs_state = AX25_DATA;
 				i = 0;
 			}
 			break;
 		case AX25_DATA:
-			retval = aprs_buf[i];
-			if (++i >= APRS_BUF_LEN) {
+			retval = aprs_tx[aprs_tx_frame]->info[i];
+			if (++i >= aprs_tx[aprs_tx_frame]->info_len) {
 				aprs_state = AX25_FCS1;
 				i = 0;
 			}
 			break;
 		case AX25_FCS1:
-			retval = (uint8_t)fcs;
+			retval = (uint8_t)aprs_tx[aprs_tx_frame]->fcs;
 			aprs_state = AX25_FCS2;
 			break;
 		case AX25_FCS2:
-			retval = (uint8_t)(fcs >> 8);
-			aprs_state = EFLAG;
+			retval = (uint8_t)(aprs_tx[aprs_tx_frame]->fcs >> 8);
+			if (++aprs_tx_frame < aprs_tx_count) {
+				aprs_state = IFLAG;
+			} else {
+				aprs_state = EFLAG;
+			}
+			break;
+		case IFLAG:
+			stuffing = 0;
+			retval = AX25_FLAG;
+			if (++i >= AX25_IFLAGS) {
+				aprs_state = AX25_HEADER;
+				i = 0;
+			}
 			break;
 		case EFLAG:
 			stuffing = 0;
@@ -331,6 +657,152 @@ uint8_t get_next_bit(void) {
 	return bit_d;
 }
 
+/*
+ * aprs_encode_stream
+ *
+ * runs the AX.25 state machine over all frames in aprs_tx once, storing
+ * the bit stuffed and NRZI coded output in aprs_stream. the transmit loop
+ * then only has to shift bits out of the buffer.
+ */
+static void aprs_encode_stream(void) {
+	uint16_t n = 0;
+
+	aprs_init();
+	do {
+		if (get_next_bit()) {
+			aprs_stream[n >> 3] |= (1 << (n & 0x07));
+		} else {
+			aprs_stream[n >> 3] &= ~(1 << (n & 0x07));
+		}
+		n++;
+	} while (!finished && n < APRS_STREAM_BITS);
+	aprs_stream_bits = n;
+}
+
+/*
+ * aprs_encode_frame
+ *
+ * calculates the FCS and encodes the frame prepared last (aprs_buf or Mic-E)
+ * as a single frame into aprs_stream.
+ *
+ * has to be called again whenever the header or buffer changes.
+ */
+void aprs_encode_frame(void) {
+	calculate_fcs();
+	aprs_tx[0] = &aprs_single;
+	aprs_tx_count = 1;
+	aprs_encode_stream();
+}
+
+/*
+ * aprs_queue_frame
+ *
+ * stores a copy of the frame prepared last (aprs_prepare_buffer or
+ * aprs_prepare_mice) for the next burst
+ *
+ * returns: 0 on success, 1 if the queue is full
+ */
+uint8_t aprs_queue_frame(void) {
+	if (aprs_queued >= APRS_QUEUE_LEN) {
+		return 1;
+	}
+	aprs_current_frame(&aprs_queue[aprs_queued]);
+	aprs_queued++;
+	return 0;
+}
+
+/*
+ * aprs_queue_count
+ *
+ * returns: number of frames waiting for the next burst
+ */
+uint8_t aprs_queue_count(void) {
+	return aprs_queued;
+}
+
+/*
+ * aprs_encode_burst
+ *
+ * encodes all queued frames into aprs_stream, separated by AX25_IFLAGS flags,
+ * so a following tx_aprs sends them with a single TX delay and start flag
+ * preamble. empties the queue.
+ *
+ * returns: number of frames encoded, aprs_stream is unchanged if 0
+ */
+uint8_t aprs_encode_burst(void) {
+	uint8_t i;
+
+	if (aprs_queued == 0) {
+		return 0;
+	}
+	for (i = 0; i < aprs_queued; i++) {
+		/* the header may have changed since the frame was queued */
+		aprs_queue[i].fcs = aprs_frame_fcs(&aprs_queue[i]);
+		aprs_tx[i] = &aprs_queue[i];
+	}
+	aprs_tx_count = aprs_queued;
+	aprs_queued = 0;
+	aprs_encode_stream();
+	return aprs_tx_count;
+}
+
+#ifdef APRS_LOOPBACK_CHECK
+/*
+ * aprs_loopback_check
+ *
+ * runs aprs_stream through the AX.25 decoder and compares the frame with
+ * the header and info field encoded, then measures encoder and decoder throughput.
+ * aprs_encode_frame has to be called before.
+ *
+ * returns:	0 if the frame decodes correctly, the decoder error or 1 on a
+ * 			content mismatch otherwise
+ */
+int16_t aprs_loopback_check(void) {
+	uint8_t frame[APRS_FRAME_LEN];
+	int16_t len;
+	uint16_t i;
+	uint32_t start, enc_ms, dec_ms;
+
+	len = ax25_decode(aprs_stream, aprs_stream_bits, frame, sizeof(frame));
+	if (len < 0) {
+		printf("APRS loopback: decoder error %d\r\n", len);
+		return len;
+	}
+	if (len != aprs_header_len + aprs_single.info_len) {
+		printf("APRS loopback: frame length %d\r\n", len);
+		return 1;
+	}
+	for (i = 0; i < aprs_header_len; i++) {
+		if (frame[i] != ((i < APRS_ADDR_LEN && aprs_single.own_dst) ? aprs_single.dst[i] : aprs_header[i])) {
+			printf("APRS loopback: header mismatch at %u\r\n", i);
+			return 1;
+		}
+	}
+	for (i = 0; i < aprs_single.info_len; i++) {
+		if (frame[aprs_header_len + i] != (uint8_t)aprs_single.info[i]) {
+			printf("APRS loopback: payload mismatch at %u\r\n", i);
+			return 1;
+		}
+	}
+
+	start = HAL_GetTick();
+	for (i = 0; i < APRS_LOOPBACK_RUNS; i++) {
+		aprs_encode_frame();
+	}
+	enc_ms = HAL_GetTick() - start;
+
+	start = HAL_GetTick();
+	for (i = 0; i < APRS_LOOPBACK_RUNS; i++) {
+		ax25_decode(aprs_stream, aprs_stream_bits, frame, sizeof(frame));
+	}
+	dec_ms = HAL_GetTick() - start;
+
+	printf("APRS loopback ok, %u bits/frame, encode %lu ms, decode %lu ms for %u frames\r\n",
+			aprs_stream_bits, (unsigned long)enc_ms, (unsigned long)dec_ms, APRS_LOOPBACK_RUNS);
+	return 0;
+}
+#endif
+
 /*
  * tx_aprs
  *
@@ -338,35 +810,65 @@ uint8_t get_next_bit(void) {
  *
  */
 void tx_aprs(void) {
-	aprs_init();
+	uint16_t n = 0;
+	uint32_t keyup = getCycleCount();
+
 	ledOnGreen();
 	deassertSiGPIO3();
+#ifndef APRS_USE_DMA
 	startAprsTickTimer();
+#endif
 
+	/* wake the radio up, restoring its registers if it was shut down */
+	si4060_set_power(SI_PWR_TX_TUNE);
 	/* use 2FSK mode so we can adjust the OFFSET register */
 	si4060_setup(MOD_TYPE_2GFSK);
+#ifdef APRS_USE_SINE
+	/* all deviation comes from MODEM_FREQ_OFFSET */
+	si4060_set_property_24(PROP_MODEM, MODEM_FREQ_DEV, 0);
+#endif
 	si4060_start_tx(0);
-	/* add some TX delay */
-	HAL_Delay(250);
+	/* modulate as soon as the carrier is valid, the AX25_SFLAGS opening
+	 * flags are the TX delay receivers need */
+	if (si4060_wait_state(STATE_TX, SI_STATE_TIMEOUT_US) != SI_OK) {
+		printf("APRS: radio did not reach TX\r\n");
+	}
+	keyup = getCycleCount() - keyup;
 
+#if defined(APRS_USE_DMA)
+	/* the whole frame is played by TIM15 + DMA, nothing to do until it ends */
+	afsk_dma_start();
+	while (afsk_dma_busy()) {
+		__WFI();
+	}
+#elif defined(APRS_USE_SINE)
+	/* the whole frame is played from the TIM15 interrupt */
+	afsk_sine_start();
+	while (afsk_sine_busy()) {
+		__WFI();
+	}
+	afsk_sine_finish();
+	printf("APRS sine AFSK: %u late samples, %lu of %u cycles per sample\r\n",
+			afsk_sine_overruns(), (unsigned long)afsk_sine_max_cycles(),
+			AFSK_SINE_WRITE_CYCLES);
+#else
 	aprs_tick = 0;
 	do {
 		if (aprs_tick) {
-			/* running with APRS sample clock */
+			/* edge of the NCO tone output */
 			aprs_tick = 0;
 			toggleSiGPIO3();
-			if (aprs_baud_tick) {
-				/* running with bit clock (1200 / sec) */
-				//WDTCTL = WDTPW + WDTCNTCL + WDTIS1;
-				aprs_baud_tick = 0;
-				//toggleSiGPIO3();
-
-				if (get_next_bit()) {
-					aprs_bit = APRS_SPACE;
-				} else {
-					aprs_bit = APRS_MARK;
-				}
+		}
+		if (aprs_baud_tick) {
+			/* running with bit clock (1200 / sec), independent of the tone edges */
+			aprs_baud_tick = 0;
+
+			if (aprs_stream[n >> 3] & (1 << (n & 0x07))) {
+				aprs_bit = APRS_SPACE;
+			} else {
+				aprs_bit = APRS_MARK;
 			}
+			n++;
 
 			/* tell us when we fail to meet the timing */
 //			if (aprs_tick) {
@@ -375,7 +877,8 @@ void tx_aprs(void) {
 //				}
 //			}
 		}
-	} while(!finished);
+	} while(n < aprs_stream_bits);
+#endif
 
 	deassertSiGPIO3();
 
@@ -383,6 +886,10 @@ void tx_aprs(void) {
 	si4060_stop_tx();
 	stopAprsTickTimer();
 	ledOffGreen();
+
+	/* from the wake up of the radio to a valid carrier */
+	printf("APRS key-up: %lu us\r\n",
+			(unsigned long)(keyup / (SystemCoreClock / 1000000)));
 }
 
 
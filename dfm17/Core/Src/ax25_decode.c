@@ -0,0 +1,109 @@
+/**
+  ******************************************************************************
+  * @file    ax25_decode.c
+  * @brief   This file contains an AX.25 receiver for the encoded bitstream
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  * Reverses the transmit path of aprs.c on a stored bitstream (LSB first, one
+  * bit per baud): NRZI decoding, flag detection, bit destuffing and the FCS
+  * check. Used to verify the encoder on target, it does not demodulate audio.
+  ******************************************************************************
+  */
+
+#include "ax25_decode.h"
+#include "fcs.h"
+
+/*
+ * ax25_decode
+ *
+ * decodes the first complete frame from an NRZI coded, bit stuffed bitstream.
+ *
+ * stream:	the bitstream, LSB first (e.g. aprs_stream)
+ * bits:	number of valid bits in stream
+ * frame:	output buffer for the frame including the two FCS bytes
+ * max_len:	size of frame
+ *
+ * returns:	the frame length without FCS, or one of AX25_ERR_x
+ */
+int16_t ax25_decode(const uint8_t *stream, uint16_t bits, uint8_t *frame, uint16_t max_len) {
+	uint16_t n;
+	uint16_t len = 0;
+	uint8_t level, prev, bit;
+	uint8_t ones = 0;
+	uint8_t byte = 0;
+	uint8_t nbits = 0;
+	uint8_t in_frame = 0;
+
+	if (bits == 0) {
+		return AX25_ERR_NOFRAME;
+	}
+
+	prev = stream[0] & 0x01;
+	for (n = 1; n < bits; n++) {
+		/* NRZI: no transition is a one */
+		level = (stream[n >> 3] >> (n & 0x07)) & 0x01;
+		bit = (level == prev);
+		prev = level;
+
+		if (bit) {
+			if (++ones > 6) {
+				/* abort sequence, wait for the next flag */
+				in_frame = 0;
+				continue;
+			}
+		} else {
+			if (ones == 6) {
+				/* flag, the first 7 bits of it have already been shifted in */
+				if (in_frame && len >= AX25_MIN_FRAME_LEN && nbits == 7) {
+					if (fcs_update(FCS_INIT, frame, len) != FCS_RESIDUE) {
+						return AX25_ERR_FCS;
+					}
+					return len - 2;
+				}
+				in_frame = 1;
+				len = 0;
+				byte = 0;
+				nbits = 0;
+				ones = 0;
+				continue;
+			}
+			if (ones == 5) {
+				/* stuffed zero */
+				ones = 0;
+				continue;
+			}
+			ones = 0;
+		}
+
+		if (!in_frame) {
+			continue;
+		}
+		byte = (byte >> 1) | (bit << 7);
+		if (++nbits == 8) {
+			if (len >= max_len) {
+				return AX25_ERR_OVERFLOW;
+			}
+			frame[len++] = byte;
+			nbits = 0;
+		}
+	}
+	return AX25_ERR_NOFRAME;
+}
@@ -59,9 +59,6 @@ void MX_GPIO_Init(void)
   __HAL_RCC_GPIOA_CLK_ENABLE();
   __HAL_RCC_GPIOB_CLK_ENABLE();
 
-  /*Configure GPIO pin Output Level */
-  HAL_GPIO_WritePin(oSpiGPIO2_GPIO_Port, oSpiGPIO2_Pin, GPIO_PIN_RESET);
-
   /*Configure GPIO pin Output Level */
   HAL_GPIO_WritePin(GPIOC, oBattOn_Pin|oSiSDN_Pin, GPIO_PIN_SET);
 
@@ -79,9 +76,8 @@ void MX_GPIO_Init(void)
 
   /*Configure GPIO pin : PtPin */
   GPIO_InitStruct.Pin = oSpiGPIO2_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
   GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(oSpiGPIO2_GPIO_Port, &GPIO_InitStruct);
 
   /*Configure GPIO pins : PCPin PCPin PCPin PCPin */
@@ -140,10 +136,6 @@ void deassertSiGPIO3(void) {
 	GPIOA->BSRR = (1 << (16+4));
 }
 
-void toggleSiGPIO2(void) {
-	GPIOD->ODR ^= (1 << 0);
-}
-
 void togglePB9(void) {
 	GPIOB->ODR ^= (1 << 9);
 }
@@ -34,7 +34,19 @@ extern GNSS_StateHandle GNSS_Handle;
 volatile uint8_t ppsLockStatus;
 
 
+/*
+ * prints a 1e-7 deg fixed point value
+ */
+static void printDeg(const char *name, int32_t deg) {
+	uint32_t a = (deg < 0) ? -(uint32_t)deg : (uint32_t)deg;
+
+	printf("%s: %s%lu.%07lu \r\n", name, (deg < 0) ? "-" : "",
+			(unsigned long)(a / 10000000), (unsigned long)(a % 10000000));
+}
+
 void gpsUpdate(void) {
+		GNSS_Fix fix;
+
 		printf("GPS Update!\r\n");
 
 		if(!ppsLockStatus) {
@@ -45,31 +57,37 @@ void gpsUpdate(void) {
 		if( GNSS_Handle.uniqueID[0] == 0x00 && GNSS_Handle.uniqueID[1] == 0x00 &&
 				GNSS_Handle.uniqueID[2] == 0x00 && GNSS_Handle.uniqueID[3] == 0x00 &&
 				GNSS_Handle.uniqueID[4] == 0x00) {
-			GNSS_GetUniqID(&GNSS_Handle);
+			GNSS_GetUniqID(&GNSS_Handle, NULL);
 
 		}
 
-		GNSS_GetPVTData(&GNSS_Handle);
+		// NAV-PVT is pushed by the receiver and parsed in the background,
+		// poll only if the periodic output was not acknowledged
+		if(!GNSS_Handle.pvtPeriodic) {
+			GNSS_GetPVTData(&GNSS_Handle, NULL);
+		}
 
 
 		if(GNSS_Handle.selectedMode == ModeNotSet){
 			GNSS_SetMode(&GNSS_Handle,ModeAutomotive);
 		}
 
-		printf("Status of fix: %d \r\n", GNSS_Handle.fixType);
-
-		if(GNSS_Handle.fixType >= Fix2D) {
-			printf("Day: %d-%02d-%02d \r\n", GNSS_Handle.year, GNSS_Handle.month,GNSS_Handle.day);
-			printf("Time: %02d:%02d:%02d UTC \r\n", GNSS_Handle.hour, GNSS_Handle.min,GNSS_Handle.sec);
-
-			printf("Number of Sats: %d \r\n", GNSS_Handle.numSV);
-
-			printf("Latitude: %f \r\n", GNSS_Handle.fLat);
-			printf("Longitude: %f \r\n",(float) GNSS_Handle.lon / 10000000.0);
+		GNSS_GetFix(&GNSS_Handle, &fix);
+		printf("Status of fix: %d \r\n", fix.fixType);
 
+		if(fix.fixType >= Fix2D) {
+			printf("Day: %d-%02d-%02d \r\n", fix.year, fix.month, fix.day);
+			printf("Time: %02d:%02d:%02d UTC \r\n", fix.hour, fix.min, fix.sec);
 
+			printf("Number of Sats: %d \r\n", fix.numSV);
 
+			printDeg("Latitude", fix.lat);
+			printDeg("Longitude", fix.lon);
 		}
+		printf("GPS link: %lu baud, NAV-PVT poll %lu us at %d, %lu us at %d\r\n",
+			(unsigned long)GNSS_Handle.baud,
+			(unsigned long)GNSS_Handle.pvtLatencyUs[0], GNSS_BAUD_DEFAULT,
+			(unsigned long)GNSS_Handle.pvtLatencyUs[1], GNSS_BAUD_FAST);
 		printf("Unique ID: %02X %02X %02X %02X %02X \r\n",
 			GNSS_Handle.uniqueID[0], GNSS_Handle.uniqueID[1],
 			GNSS_Handle.uniqueID[2], GNSS_Handle.uniqueID[3],
@@ -78,15 +96,22 @@ void gpsUpdate(void) {
 
 }
 
-void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)	{
-	//printf("  TxComplete callback!\r\n");
-	GNSS_Handle.txDone = 1;
+/*
+ * receive ring events (half, full, idle line), size is the DMA write position
+ */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t size) {
+	if (huart == GNSS_Handle.huart) {
+		GNSS_ParseBuffer(&GNSS_Handle, size);
+	}
 }
 
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
-	//printf("  RxComplete callback!\r\n");
-	GNSS_ParseBuffer(&GNSS_Handle);
-	GNSS_Handle.rxDone = 1; //todo try *GNSS to mitigate warning
+/*
+ * an error aborts the DMA reception, restart the ring
+ */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+	if (huart == GNSS_Handle.huart) {
+		GNSS_StartRx(&GNSS_Handle);
+	}
 }
 
 /**
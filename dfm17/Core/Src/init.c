@@ -32,13 +32,12 @@
 #include "spi.h"
 #include "tim.h"
 #include "si4063.h"
+#include "si4063_cfg.h"
 
 
 extern UART_HandleTypeDef huart2;
 extern TIM_HandleTypeDef htim6;
 extern GNSS_StateHandle GNSS_Handle;
-extern uint8_t txDone;
-extern uint8_t rxDone;
 
 void initHw(void) {
 	// initialize STM hardware
@@ -57,7 +56,7 @@ void initHw(void) {
 
 	// initialize GPS chip
 	printf("Starting ublox...\r\n");
-	GNSS_Init(&GNSS_Handle, &huart2, &txDone, &rxDone);
+	GNSS_Init(&GNSS_Handle, &huart2);
 	HAL_Delay(1000);
 	GNSS_LoadConfig(&GNSS_Handle);
 
@@ -67,6 +66,8 @@ void initHw(void) {
 
 void initRadio() {
 	SpiEnable();
+	// CTS timeouts of the radio driver run on the cycle counter
+	startCycleCounter();
 
 	//restart radio
 	printf("wake up radio...\r\n");
@@ -84,10 +85,19 @@ void initRadio() {
 		printf("ERROR: Incorrect radio, not a 4063!\r\n");
 	}
 
-	si4060_power_up(); 		//power up radio
-	si4060_setup(MOD_TYPE_2GFSK);
+	// power up and configure the radio from the precompiled streams,
+	// timing the whole configuration
+	uint32_t cycles;
+	cycles = getCycleCount();
+	if (si4060_replay(si4060_cfg_setup) != SI_OK) {
+		printf("ERROR: Radio did not respond to configuration!\r\n");
+	}
 	si4060_freq_aprs_dfm17();
-	si4060_change_state(STATE_TX);
+	cycles = getCycleCount() - cycles;
+	printf("Radio config: %lu us\r\n",
+			(unsigned long)(cycles / (SystemCoreClock / 1000000)));
+	si4060_print_stats();
+	si4060_set_power(SI_PWR_TX);
 
 	startAprsTickTimer();
 
@@ -55,9 +55,12 @@
   * | INTERRUPT | Priority | Purpose                        |
   * |-----------|----------|--------------------------------|
   * | TIM15     |    1     | APRS Baud Clock                |
+  * | DMA5      |    1     | APRS AFSK waveform DMA refill  |
+  * | DMA2/3    |    5     | Radio SPI1 RX/TX DMA           |
   * | TIM16     |    2     | RTTY Baud Clock                |
-  * | DMA6      |    6     | GPS UART RX DMA                |
   * | DMA7      |    7     | GPS UART TX DMA                |
+  * | DMA6      |    9     | GPS UART RX ring half/full     |
+  * | USART2    |    9     | GPS UART idle line, UBX parser |
   * | TIM6      |   10     | GPS Update Tick Timer          |
   * | TIM7      |   14     | GPS Lock timer                 |
   * | EXTIO     |   15     | GPS 1pps input interrupt       |
@@ -86,6 +89,7 @@
 #include "GNSS.h"
 #include "init.h"
 #include "aprs.h"
+#include "si4063.h"
 
 /* USER CODE END Includes */
 
@@ -107,9 +111,9 @@
 
 /* USER CODE BEGIN PV */
 
-volatile GNSS_StateHandle GNSS_Handle;
-volatile uint8_t txDone;
-volatile uint8_t rxDone;
+/* shared with the UART, DMA and SysTick interrupts, GNSS.c protects its
+ * fields itself (PRIMASK for the request queue, a sequence count for the fix) */
+GNSS_StateHandle GNSS_Handle;
 
 volatile uint16_t aprs_bit;
 volatile uint16_t aprs_tick;
@@ -126,39 +130,6 @@ void SystemClock_Config(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
-static uint16_t calc_aprscrc (uint16_t crcStart, uint8_t *frame, uint8_t frame_len)
-{
-
-    uint8_t i, j;
-    // Preload the CRC register with ones
-    //uint16_t crc = 0xffff;
-    uint16_t crc = crcStart;
-
-
-    // Iterate over every octet in the frame
-    for (i = 0; i < frame_len; i++)
-    {
-        // Iterate over every bit, LSb first
-        for (j = 0; j < 8; j++)
-        {
-            uint8_t bit = (frame[i] >> j) & 0x01;
-
-            // Divide by a bit - reversed 0x1021
-            if ((crc & 0x0001) != bit)
-            {
-                crc = (crc >> 1) ^ 0x8408;
-            }
-            else
-            {
-                crc = crc >> 1;
-            }
-        }
-    }
-
-
-    return crc;
-}
-
 /* USER CODE END 0 */
 
 /**
@@ -195,7 +166,10 @@ int main(void)
 
 
   aprs_prepare_buffer(&GNSS_Handle, 0);
-  calculate_fcs();
+  aprs_encode_frame();
+#ifdef APRS_LOOPBACK_CHECK
+  aprs_loopback_check();
+#endif
 
   stopGpsLockTimer();
   stopGpsTickTimer();
@@ -211,7 +185,11 @@ int main(void)
 
 
     /* USER CODE BEGIN 3 */
+	  /* park the radio in the lowest power state that still wakes up in time */
+	  si4060_set_power(si4060_power_for_deadline(2000UL * 1000));
 	  HAL_Delay(2000);
+	  /* send the latest fix, not the one from start up */
+	  aprs_prepare_buffer(&GNSS_Handle, 0);
 	  tx_aprs();
 
   }
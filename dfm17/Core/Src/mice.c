@@ -0,0 +1,130 @@
+/**
+  ******************************************************************************
+  * @file    mice.c
+  * @brief   This file contains the Mic-E position encoder
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  ******************************************************************************
+  * Mic-E, APRS Protocol Reference 1.0.1 chapter 10. Integer only, fed with the
+  * raw UBX values of the GNSS_Fix snapshot (1e-7 deg, mm, mm/s, 1e-5 deg).
+  ******************************************************************************
+  */
+
+#include "mice.h"
+
+/*
+ * mice_split
+ *
+ * splits an absolute coordinate into degrees and hundredths of minutes
+ *
+ * val:	coordinate in 1e-7 deg, >= 0
+ */
+static void mice_split(uint32_t val, uint16_t *deg, uint16_t *min100) {
+	*deg = val / 10000000UL;
+	/* 1e-7 deg -> 1/100 min: * 60 * 100 / 1e7 */
+	*min100 = (val % 10000000UL) * 6 / 10000UL;
+}
+
+/*
+ * mice_encode
+ *
+ * encodes a fix as Mic-E.
+ *
+ * dst_call:	destination callsign, MICE_DST_LEN characters plus terminator
+ * info:		info field, MICE_INFO_LEN bytes
+ *
+ * returns: length of the info field
+ */
+uint8_t mice_encode(const GNSS_Fix *fix, char *dst_call, char *info) {
+	uint16_t lat_deg, lat_min, lon_deg, lon_min;
+	uint8_t digits[MICE_DST_LEN];
+	uint8_t flags[MICE_DST_LEN];
+	uint32_t lat, lon, speed, course;
+	int32_t alt;
+	uint8_t i, lon_offset;
+
+	lat = fix->lat < 0 ? -(uint32_t)fix->lat : (uint32_t)fix->lat;
+	lon = fix->lon < 0 ? -(uint32_t)fix->lon : (uint32_t)fix->lon;
+	mice_split(lat, &lat_deg, &lat_min);
+	mice_split(lon, &lon_deg, &lon_min);
+	lon_offset = (lon_deg < 10 || lon_deg >= 100);
+
+	/* destination: latitude digits, P..Y if the flag is set, 0..9 otherwise */
+	digits[0] = lat_deg / 10;
+	digits[1] = lat_deg % 10;
+	digits[2] = lat_min / 1000;
+	digits[3] = (lat_min / 100) % 10;
+	digits[4] = (lat_min / 10) % 10;
+	digits[5] = lat_min % 10;
+	flags[0] = (MICE_MSG >> 2) & 0x01;
+	flags[1] = (MICE_MSG >> 1) & 0x01;
+	flags[2] = MICE_MSG & 0x01;
+	flags[3] = fix->lat >= 0;		/* north */
+	flags[4] = lon_offset;
+	flags[5] = fix->lon < 0;		/* west */
+	for (i = 0; i < MICE_DST_LEN; i++) {
+		dst_call[i] = (flags[i] ? 'P' : '0') + digits[i];
+	}
+	dst_call[MICE_DST_LEN] = 0;
+
+	/* longitude */
+	info[0] = MICE_DATA_CURRENT;
+	if (lon_deg < 10) {
+		info[1] = lon_deg + 118;
+	} else if (lon_deg < 100) {
+		info[1] = lon_deg + 28;
+	} else if (lon_deg < 110) {
+		info[1] = lon_deg + 8;
+	} else {
+		info[1] = lon_deg - 72;
+	}
+	info[2] = (lon_min / 100 < 10) ? lon_min / 100 + 88 : lon_min / 100 + 28;
+	info[3] = lon_min % 100 + 28;
+
+	/* speed in knots (mm/s / 514.444, max 799) and course in deg */
+	speed = fix->gSpeed > 0 ? (uint32_t)fix->gSpeed : 0;
+	if (speed > 411000UL) {
+		speed = 411000UL;
+	}
+	speed = speed * 1000UL / 514444UL;
+	course = fix->headMot > 0 ? (uint32_t)fix->headMot / 100000UL : 0;
+	if (course > 359) {
+		course = 359;
+	}
+	info[4] = (speed / 10 < 20) ? speed / 10 + 108 : speed / 10 + 28;
+	info[5] = (speed % 10) * 10 + course / 100 + 28;
+	info[6] = course % 100 + 28;
+
+	info[7] = MICE_SYMBOL;
+	info[8] = MICE_SYMBOL_TABLE;
+
+	/* altitude in m, offset by 10000, three base91 digits */
+	alt = fix->hMSL / 1000 + 10000;
+	if (alt < 0) {
+		alt = 0;
+	}
+	info[9] = 33 + (alt / (91 * 91)) % 91;
+	info[10] = 33 + (alt / 91) % 91;
+	info[11] = 33 + alt % 91;
+	info[12] = '}';
+
+	return MICE_INFO_LEN;
+}
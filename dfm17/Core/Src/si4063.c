@@ -31,20 +31,170 @@
   ******************************************************************************
   */
 
+#include <stdio.h>
 #include "si4063.h"
-#include "spi.h"
-#include "tim.h"
+#include "si4063_cfg.h"
+#include "si4063_bus.h"
+
+/*
+ * CTS
+ * once GPIO2 of the Si4060 is configured as CTS output (see si4060_setup),
+ * CTS is read from the pin (PD0) instead of polling READ_CMD_BUF over SPI.
+ * until then, and after every shutdown, the SPI poll is used.
+ */
+static uint8_t si4060_cts_pin;
+
+/* the command the Si4060 is busy with, the next CTS wait is accounted to it */
+static uint8_t si4060_last_cmd = SI_CMD_POR;
+
+/* CTS wait statistics, one entry per command in si4060_stat_cmd */
+static const uint8_t si4060_stat_cmd[SI_STAT_CMDS] = {
+	SI_CMD_POR, CMD_NOP, CMD_PART_INFO, CMD_POWER_UP, CMD_SET_PROPERTY,
+	CMD_GET_PROPERTY, CMD_GPIO_PIN_CFG, CMD_START_TX, CMD_CHANGE_STATE,
+	CMD_REQUEST_DEVICE_STATE,
+};
+static si4060_cts_stat si4060_stats[SI_STAT_CMDS];
+
+/* power state the Si4060 is in, see si4060_set_power */
+static uint8_t si4060_power = SI_PWR_SHUTDOWN;
+
+/* time from a power state to TX_TUNE in us, indexed by SI_PWR_x.
+ * starts with conservative estimates, replaced by every measured wake up */
+static uint32_t si4060_wake_us[SI_PWR_TX + 1] = {
+	[SI_PWR_SHUTDOWN] = 20000,	/* POR, POWER_UP boot and register restore */
+	[SI_PWR_STANDBY] = 1000,
+	[SI_PWR_SPI_ACTIVE] = 500,
+	[SI_PWR_READY] = 200,
+};
+
+static void si4060_stat_update(uint32_t cycles, uint8_t ret);
+static void si4060_sdn(void);
+
+/*
+ * property shadow
+ *
+ * last value written for every property the driver touches. the
+ * properties are kept in windows of consecutive numbers, a window is
+ * { group, first property, number of properties, index in si4060_shadow }.
+ * setters skip values the radio already holds; the shadow is invalidated
+ * whenever the register content of the Si4060 is lost.
+ */
+#define SI_SHADOW_GLOBAL		0
+#define SI_SHADOW_INT_CTL		(SI_SHADOW_GLOBAL + 4)
+#define SI_SHADOW_FRR_CTL		(SI_SHADOW_INT_CTL + 4)
+#define SI_SHADOW_PREAMBLE		(SI_SHADOW_FRR_CTL + 4)
+#define SI_SHADOW_SYNC			(SI_SHADOW_PREAMBLE + 1)
+#define SI_SHADOW_MODEM			(SI_SHADOW_SYNC + 1)
+#define SI_SHADOW_CLKGEN		(SI_SHADOW_MODEM + MODEM_TX_FILTER_COEFF_0 + 1)
+#define SI_SHADOW_PA			(SI_SHADOW_CLKGEN + 1)
+#define SI_SHADOW_FREQ_CONTROL	(SI_SHADOW_PA + 1)
+#define SI_SHADOW_LEN			(SI_SHADOW_FREQ_CONTROL + FREQ_CONTROL_W_SIZE + 1)
+
+static const uint8_t si4060_shadow_map[][4] = {
+	{ PROP_GLOBAL,			0x00,					4,	SI_SHADOW_GLOBAL },
+	{ PROP_INT_CTL,			0x00,					4,	SI_SHADOW_INT_CTL },
+	{ PROP_FRR_CTL,			0x00,					4,	SI_SHADOW_FRR_CTL },
+	{ PROP_PREAMBLE,		PREAMBLE_TX_LENGTH,		1,	SI_SHADOW_PREAMBLE },
+	{ PROP_SYNC,			SYNC_CONFIG,			1,	SI_SHADOW_SYNC },
+	{ PROP_MODEM,			MODEM_MOD_TYPE,			MODEM_TX_FILTER_COEFF_0 + 1,	SI_SHADOW_MODEM },
+	{ PROP_MODEM,			MODEM_CLKGEN_BAND,		1,	SI_SHADOW_CLKGEN },
+	{ PROP_PA,				PA_BIAS_CLKDUTY,		1,	SI_SHADOW_PA },
+	{ PROP_FREQ_CONTROL,	FREQ_CONTROL_INTE,		FREQ_CONTROL_W_SIZE + 1,	SI_SHADOW_FREQ_CONTROL },
+};
+
+static uint8_t si4060_shadow[SI_SHADOW_LEN];
+static uint8_t si4060_shadow_valid[(SI_SHADOW_LEN + 7) / 8];
+
+/* GPIO_PIN_CFG has no property, its 7 argument bytes are shadowed separately */
+static uint8_t si4060_gpio_shadow[7];
+static uint8_t si4060_gpio_shadow_valid;
+
+/*
+ * command bursts go out by DMA. only one is in flight: every command
+ * starts with a polled CTS wait, which waits for the previous burst first.
+ */
+static uint8_t si4060_cmd_buf[4 + SI_MAX_PROPS];
+
+/*
+ * si4060_send
+ *
+ * starts a DMA burst of a complete command, the caller has waited for CTS.
+ * cmd has to stay valid until the next CTS wait.
+ */
+static void si4060_send(const uint8_t *cmd, uint8_t len) {
+	si4060_last_cmd = cmd[0];
+	si4060_bus_send(cmd, len);
+}
+
+/*
+ * si4060_shadow_index
+ *
+ * returns:	the index of a property in si4060_shadow, -1 if it is not shadowed
+ */
+static int8_t si4060_shadow_index(uint8_t group, uint8_t prop) {
+	uint8_t i;
+
+	for (i = 0; i < sizeof(si4060_shadow_map) / sizeof(si4060_shadow_map[0]); i++) {
+		if (si4060_shadow_map[i][0] == group
+				&& (uint8_t)(prop - si4060_shadow_map[i][1]) < si4060_shadow_map[i][2]) {
+			return si4060_shadow_map[i][3] + (prop - si4060_shadow_map[i][1]);
+		}
+	}
+	return -1;
+}
+
+/*
+ * si4060_shadow_hit
+ *
+ * returns:	1 if the radio is known to hold val in the property, 0 otherwise
+ */
+static uint8_t si4060_shadow_hit(uint8_t group, uint8_t prop, uint8_t val) {
+	int8_t idx = si4060_shadow_index(group, prop);
+
+	return idx >= 0
+			&& (si4060_shadow_valid[idx >> 3] & (1 << (idx & 0x07)))
+			&& si4060_shadow[idx] == val;
+}
+
+static void si4060_shadow_store(uint8_t group, uint8_t prop, uint8_t val) {
+	int8_t idx = si4060_shadow_index(group, prop);
+
+	if (idx >= 0) {
+		si4060_shadow[idx] = val;
+		si4060_shadow_valid[idx >> 3] |= (1 << (idx & 0x07));
+	}
+}
+
+/*
+ * si4060_shadow_forget
+ *
+ * marks a property as unknown, for writes the radio may not have taken
+ */
+static void si4060_shadow_forget(uint8_t group, uint8_t prop) {
+	int8_t idx = si4060_shadow_index(group, prop);
+
+	if (idx >= 0) {
+		si4060_shadow_valid[idx >> 3] &= ~(1 << (idx & 0x07));
+	}
+}
+
+/*
+ * si4060_invalidate_shadow
+ *
+ * forgets all shadowed property values, the next write of every property
+ * goes to the radio. called when the Si4060 loses its register content.
+ */
+void si4060_invalidate_shadow(void) {
+	uint8_t i;
+
+	for (i = 0; i < sizeof(si4060_shadow_valid); i++) {
+		si4060_shadow_valid[i] = 0;
+	}
+	si4060_gpio_shadow_valid = 0;
+}
 
 void si4060_freq_aprs_dfm17(void) {
-	si4060_set_aprs_params_TESTING();
-	/* set up the integer divider */
-	si4060_set_property_8(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_INTE,
-			(uint8_t)FDIV_INTE_DFM);
-	/* set up the fractional divider */
-	si4060_set_property_24(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_FRAC,
-			(uint32_t)FDEV_DFM);
+	si4060_replay(si4060_cfg_aprs_dfm17);
 }
 
 /*
@@ -64,11 +214,24 @@ void si4060_reset(void) {
  * all register content is lost.
  */
 void si4060_shutdown(void) {
-	// SDN is PC3
-	GPIOC->BSRR = (1U << +3);
+	si4060_invalidate_shadow();
+	si4060_sdn();
+}
+
+/*
+ * si4060_sdn
+ *
+ * pulls SDN high. the property shadow is left alone, so it still holds
+ * what si4060_restore has to write back after the next POWER_UP.
+ */
+static void si4060_sdn(void) {
+	si4060_cts_pin = 0;
+	si4060_last_cmd = SI_CMD_POR;
+	si4060_power = SI_PWR_SHUTDOWN;
+	si4060_bus_sdn(1);
 	/* wait 10us */
 	//__delay_cycles(50000);
-	delay_us(10);
+	si4060_bus_delay_us(10);
 }
 
 /*
@@ -78,11 +241,10 @@ void si4060_shutdown(void) {
  * si4060_power_up and si4060_setup have to be called afterwards
  */
 void si4060_wakeup(void) {
-	// SDN is PC3
-	GPIOC->BSRR = (1U << (16+3));
+	si4060_bus_sdn(0);
 	/* wait 20ms */
 	//__delay_cycles(50000);
-	delay_us(50);
+	si4060_bus_delay_us(50);
 	si4060_get_cts(0);
 }
 
@@ -101,47 +263,151 @@ uint16_t si4060_part_info(void) {
 
 	si4060_get_cts(0);
 	temp = 0;
-	spi_select();
-	spi_write(CMD_PART_INFO);
-	spi_deselect();
+	si4060_bus_select();
+	si4060_bus_write(CMD_PART_INFO);
+	si4060_last_cmd = CMD_PART_INFO;
+	si4060_bus_deselect();
 	si4060_get_cts(1);
-	spi_read();	 	/* ignore CHIPREV */
-	temp = spi_read(); 	/* read PART[0] */
+	si4060_bus_read();	 	/* ignore CHIPREV */
+	temp = si4060_bus_read(); 	/* read PART[0] */
 	temp = temp << 8;
-	temp |= spi_read(); 	/* read PART[1] */
-	spi_deselect();
+	temp |= si4060_bus_read(); 	/* read PART[1] */
+	si4060_bus_deselect();
 	return temp;
 }
 
 /*
  * si4060_get_cts
  *
- * waits for a CTS from the Si4060, includes a "time out"
+ * waits for a CTS from the Si4060, at most SI_CTS_TIMEOUT_US.
+ * the time spent waiting is added to the statistics of the last command.
  *
  * read_response: do not deselect the slave, if you want to read from it afterwards
+ *
+ * returns:	SI_OK, or SI_ERR_CTS_TIMEOUT if the Si4060 did not get ready
  */
 uint8_t si4060_get_cts(uint8_t read_response) {
-	uint8_t temp = 0;
-	uint8_t timeout = 0;
-	if (!read_response) {
-		while (si4060_read_cmd_buf(1) != 0xff && timeout < SI_TIMEOUT) {
-			timeout++;
-			delay_us(5);
+	uint32_t start, timeout;
+	uint8_t ret = SI_ERR_CTS_TIMEOUT;
+
+	/* the last command may still be on the bus */
+	si4060_bus_wait();
+	start = si4060_bus_cycles();
+	timeout = SI_CTS_TIMEOUT_US * (SystemCoreClock / 1000000);
+
+	if (si4060_cts_pin) {
+		do {
+			if (si4060_bus_cts()) {
+				ret = SI_OK;
+				break;
+			}
+		} while (si4060_bus_cycles() - start < timeout);
+		if (ret == SI_OK && read_response) {
+			/* the response follows the CTS byte of READ_CMD_BUF */
+			si4060_read_cmd_buf(0);
 		}
 	} else {
-		while (temp != 0xff && timeout < SI_TIMEOUT) {
-			timeout++;
-			temp = si4060_read_cmd_buf(0);
-			if (temp != 0xff) {
-				spi_deselect();
+		do {
+			if (si4060_read_cmd_buf(!read_response) == 0xff) {
+				ret = SI_OK;
+				break;
 			}
+			if (read_response) {
+				si4060_bus_deselect();
+			}
+			si4060_bus_delay_us(5);
+		} while (si4060_bus_cycles() - start < timeout);
+	}
+
+	si4060_stat_update(si4060_bus_cycles() - start, ret);
+	return ret;
+}
+
+/*
+ * si4060_gpio_cfg_cts
+ *
+ * waits for the CTS of a GPIO_PIN_CFG that was just sent. until the
+ * command has run, GPIO2 still has its reset function (POR, high), so
+ * this wait polls READ_CMD_BUF over SPI. the pin is used for CTS only
+ * afterwards, and only if the wait succeeded.
+ *
+ * gpio2:	the mode GPIO2 was configured to
+ *
+ * returns:	SI_OK, or SI_ERR_CTS_TIMEOUT
+ */
+static uint8_t si4060_gpio_cfg_cts(uint8_t gpio2) {
+	uint8_t ret;
+
+	si4060_cts_pin = 0;
+	ret = si4060_get_cts(0);
+	si4060_cts_pin = (ret == SI_OK && gpio2 == GPIO_MODE_CTS);
+	return ret;
+}
+
+/*
+ * si4060_stat_update
+ *
+ * accounts a CTS wait to the command the Si4060 was busy with
+ */
+static void si4060_stat_update(uint32_t cycles, uint8_t ret) {
+	si4060_cts_stat *stat = si4060_get_cts_stats(si4060_last_cmd);
+
+	if (!stat) {
+		return;
+	}
+	stat->count++;
+	stat->total += cycles;
+	if (cycles > stat->max) {
+		stat->max = cycles;
+	}
+	if (ret != SI_OK) {
+		stat->timeouts++;
+	}
+}
+
+/*
+ * si4060_get_cts_stats
+ *
+ * cmd:		the command, or SI_CMD_POR for the wait after reset
+ *
+ * returns:	the CTS wait statistics of cmd, NULL if it is not recorded
+ */
+si4060_cts_stat *si4060_get_cts_stats(uint8_t cmd) {
+	uint8_t i;
+
+	for (i = 0; i < SI_STAT_CMDS; i++) {
+		if (si4060_stat_cmd[i] == cmd) {
+			return &si4060_stats[i];
 		}
 	}
-	//printf("timeout count: %d\r\n", timeout);
+	return NULL;
+}
 
-	// todo add error return if timeout is reached
-	return 0;
+/*
+ * si4060_print_stats
+ *
+ * prints count, average / maximum wait and timeouts of every command
+ */
+void si4060_print_stats(void) {
+	uint32_t cycles_us = SystemCoreClock / 1000000;
+	uint8_t i;
 
+	printf("Si4063 CTS wait per command:\r\n");
+	for (i = 0; i < SI_STAT_CMDS; i++) {
+		if (si4060_stats[i].count) {
+			printf("  %02X: %u x, avg %lu us, max %lu us, %u timeouts\r\n",
+					si4060_stat_cmd[i], si4060_stats[i].count,
+					(unsigned long)(si4060_stats[i].total / si4060_stats[i].count / cycles_us),
+					(unsigned long)(si4060_stats[i].max / cycles_us),
+					si4060_stats[i].timeouts);
+		}
+	}
+	printf("Si4063 wake up to TX_TUNE: shutdown %lu us, standby %lu us, "
+			"spi active %lu us, ready %lu us\r\n",
+			(unsigned long)si4060_wake_us[SI_PWR_SHUTDOWN],
+			(unsigned long)si4060_wake_us[SI_PWR_STANDBY],
+			(unsigned long)si4060_wake_us[SI_PWR_SPI_ACTIVE],
+			(unsigned long)si4060_wake_us[SI_PWR_READY]);
 }
 
 /*
@@ -158,11 +424,11 @@ uint8_t si4060_get_cts(uint8_t read_response) {
  */
 uint8_t si4060_read_cmd_buf(uint8_t deselect) {
 	uint8_t ret;
-	spi_select();
-	spi_write(CMD_READ_CMD_BUF);
-	ret = spi_read();
+	si4060_bus_select();
+	si4060_bus_write(CMD_READ_CMD_BUF);
+	ret = si4060_bus_read();
 	if (deselect) {
-		spi_deselect();
+		si4060_bus_deselect();
 	}
 	return ret;
 }
@@ -179,20 +445,22 @@ uint8_t si4060_read_cmd_buf(uint8_t deselect) {
 void si4060_power_up(void) {
 	/* wait for CTS */
 	si4060_get_cts(0);
-	spi_select();
-	spi_write(CMD_POWER_UP);
-	delay_us(10);
-	spi_write(FUNC);
+	si4060_bus_select();
+	si4060_bus_write(CMD_POWER_UP);
+	si4060_last_cmd = CMD_POWER_UP;
+	si4060_bus_delay_us(10);
+	si4060_bus_write(FUNC);
 #ifdef USE_TCXO
-	spi_write(TCXO);
+	si4060_bus_write(TCXO);
 #else
-	spi_write(0);			/* TCXO if used */
+	si4060_bus_write(0);			/* TCXO if used */
 #endif
-	spi_write((uint8_t) (XO_FREQ >> 24));
-	spi_write((uint8_t) (XO_FREQ >> 16));
-	spi_write((uint8_t) (XO_FREQ >> 8));
-	spi_write((uint8_t) XO_FREQ);
-	spi_deselect();
+	si4060_bus_write((uint8_t) (XO_FREQ >> 24));
+	si4060_bus_write((uint8_t) (XO_FREQ >> 16));
+	si4060_bus_write((uint8_t) (XO_FREQ >> 8));
+	si4060_bus_write((uint8_t) XO_FREQ);
+	si4060_bus_deselect();
+	si4060_power = SI_PWR_SPI_ACTIVE;
 	/* wait for CTS */
 	si4060_get_cts(0);
 }
@@ -201,14 +469,20 @@ void si4060_power_up(void) {
  * si4060_change_state
  *
  * changes the internal state machine state of the Si4060
+ *
+ * returns:	SI_OK, or SI_ERR_CTS_TIMEOUT if the command was not sent
  */
-void si4060_change_state(uint8_t state) {
-	si4060_get_cts(0);
-	spi_select();
-	spi_write(CMD_CHANGE_STATE);
-	spi_write(state);
-	spi_deselect();
-
+uint8_t si4060_change_state(uint8_t state) {
+	if (si4060_get_cts(0) != SI_OK) {
+		return SI_ERR_CTS_TIMEOUT;
+	}
+	si4060_bus_select();
+	si4060_bus_write(CMD_CHANGE_STATE);
+	si4060_last_cmd = CMD_CHANGE_STATE;
+	si4060_bus_write(state);
+	si4060_bus_deselect();
+	si4060_power = state;
+	return SI_OK;
 }
 
 /*
@@ -220,14 +494,64 @@ void si4060_change_state(uint8_t state) {
  */
 void si4060_start_tx(uint8_t channel) {
 	si4060_get_cts(0);
-	spi_select();
-	spi_write(CMD_START_TX);
-	spi_write(channel);
-	spi_write(START_TX_TXC_STATE_SLEEP | START_TX_RETRANSMIT_0 | START_TX_START_IMM);
+	si4060_bus_select();
+	si4060_bus_write(CMD_START_TX);
+	si4060_last_cmd = CMD_START_TX;
+	si4060_bus_write(channel);
+	si4060_bus_write(START_TX_TXC_STATE_SLEEP | START_TX_RETRANSMIT_0 | START_TX_START_IMM);
 	/* set length to 0 for direct mode (is this correct?) */
-	spi_write(0x00);
-	spi_write(0x00);
-	spi_deselect();
+	si4060_bus_write(0x00);
+	si4060_bus_write(0x00);
+	si4060_bus_deselect();
+	si4060_power = SI_PWR_TX;
+}
+
+/*
+ * si4060_get_state
+ *
+ * asks the Si4060 for its current state (REQUEST_DEVICE_STATE)
+ *
+ * returns:	the CURR_STATE (STATE_x), STATE_NOCHANGE if the radio did not answer
+ */
+uint8_t si4060_get_state(void) {
+	uint8_t state;
+
+	si4060_get_cts(0);
+	si4060_bus_select();
+	si4060_bus_write(CMD_REQUEST_DEVICE_STATE);
+	si4060_last_cmd = CMD_REQUEST_DEVICE_STATE;
+	si4060_bus_deselect();
+	if (si4060_get_cts(1) != SI_OK) {
+		return STATE_NOCHANGE;
+	}
+	state = si4060_bus_read() & 0x0f;	/* CURR_STATE */
+	si4060_bus_read();					/* ignore CURRENT_CHANNEL */
+	si4060_bus_deselect();
+	return state;
+}
+
+/*
+ * si4060_wait_state
+ *
+ * polls the Si4060 until it reports a state. START_TX returns CTS before
+ * the synthesizer has settled, the radio only reports STATE_TX once the
+ * carrier is valid.
+ *
+ * state:		the state to wait for (STATE_x)
+ * timeout_us:	maximum time to wait
+ *
+ * returns:	SI_OK, or SI_ERR_STATE_TIMEOUT
+ */
+uint8_t si4060_wait_state(uint8_t state, uint32_t timeout_us) {
+	uint32_t start = si4060_bus_cycles();
+	uint32_t timeout = timeout_us * (SystemCoreClock / 1000000);
+
+	do {
+		if (si4060_get_state() == state) {
+			return SI_OK;
+		}
+	} while (si4060_bus_cycles() - start < timeout);
+	return SI_ERR_STATE_TIMEOUT;
 }
 
 /*
@@ -248,9 +572,20 @@ void si4060_stop_tx(void) {
  *
  * offset: frequency offset from carrier frequency (PLL tuning resolution)
  *
+ * returns:	SI_OK, or SI_ERR_BUSY if the bus was in use and the offset is unchanged
  */
-void si4060_set_offset(uint16_t offset) {
-	si4060_set_property_16_nocts(PROP_MODEM, MODEM_FREQ_OFFSET, offset);
+uint8_t si4060_set_offset(uint16_t offset) {
+	if (si4060_set_property_16_nocts(PROP_MODEM, MODEM_FREQ_OFFSET, offset) != SI_OK) {
+		return SI_ERR_BUSY;
+	}
+	/* called per sample, so the shadow is updated at a fixed index */
+	si4060_shadow[SI_SHADOW_MODEM + MODEM_FREQ_OFFSET] = offset >> 8;
+	si4060_shadow[SI_SHADOW_MODEM + MODEM_FREQ_OFFSET + 1] = offset;
+	si4060_shadow_valid[(SI_SHADOW_MODEM + MODEM_FREQ_OFFSET) >> 3] |=
+			(1 << ((SI_SHADOW_MODEM + MODEM_FREQ_OFFSET) & 0x07));
+	si4060_shadow_valid[(SI_SHADOW_MODEM + MODEM_FREQ_OFFSET + 1) >> 3] |=
+			(1 << ((SI_SHADOW_MODEM + MODEM_FREQ_OFFSET + 1) & 0x07));
+	return SI_OK;
 }
 
 /*
@@ -259,9 +594,11 @@ void si4060_set_offset(uint16_t offset) {
  * implements the NOP command on the Si4060
  */
 void si4060_nop(void) {
-	spi_select();
-	spi_write(CMD_NOP);
-	spi_deselect();
+	si4060_get_cts(0);
+	si4060_bus_select();
+	si4060_bus_write(CMD_NOP);
+	si4060_last_cmd = CMD_NOP;
+	si4060_bus_deselect();
 	si4060_get_cts(0);
 }
 
@@ -275,14 +612,7 @@ void si4060_nop(void) {
  * val:		the value to set
  */
 void si4060_set_property_8(uint8_t group, uint8_t prop, uint8_t val) {
-	si4060_get_cts(0);
-	spi_select();
-	spi_write(CMD_SET_PROPERTY);
-	spi_write(group);
-	spi_write(1);
-	spi_write(prop);
-	spi_write(val);
-	spi_deselect();
+	si4060_set_properties(group, prop, &val, 1);
 }
 
 /*
@@ -297,15 +627,16 @@ void si4060_set_property_8(uint8_t group, uint8_t prop, uint8_t val) {
  */
 uint8_t si4060_get_property_8(uint8_t group, uint8_t prop) {
 	uint8_t temp = 0;
-	spi_select();
-	spi_write(CMD_GET_PROPERTY);
-	spi_write(group);
-	spi_write(1);
-	spi_write(prop);
-	spi_deselect();
+	si4060_bus_select();
+	si4060_bus_write(CMD_GET_PROPERTY);
+	si4060_last_cmd = CMD_GET_PROPERTY;
+	si4060_bus_write(group);
+	si4060_bus_write(1);
+	si4060_bus_write(prop);
+	si4060_bus_deselect();
 	si4060_get_cts(1);
-	temp = spi_read(); /* read property */
-	spi_deselect();
+	temp = si4060_bus_read(); /* read property */
+	si4060_bus_deselect();
 	return temp;
 }
 
@@ -319,36 +650,39 @@ uint8_t si4060_get_property_8(uint8_t group, uint8_t prop) {
  * val:		the value to set
  */
 void si4060_set_property_16(uint8_t group, uint8_t prop, uint16_t val) {
-	si4060_get_cts(0);
-	spi_select();
-	spi_write(CMD_SET_PROPERTY);
-	spi_write(group);
-	spi_write(2);
-	spi_write(prop);
-	spi_write(val >> 8);
-	spi_write(val);
-	spi_deselect();
+	uint8_t vals[2];
+
+	vals[0] = val >> 8;
+	vals[1] = val;
+	si4060_set_properties(group, prop, vals, 2);
 }
 
 /*
  * si4060_set_property_16_nocts
  *
  * sets an 16 bit (2 byte) property in the Si4060
- * does not check for CTS from the Si4060
+ * does not check for CTS from the Si4060 and bypasses the property shadow.
+ * does not wait for the bus either, so it can be used from interrupts.
  *
  * group:	the group number of the property
  * prop:	the number (index) of the property
  * val:		the value to set
+ *
+ * returns:	SI_OK, or SI_ERR_BUSY if the bus was in use and nothing was sent
  */
-void si4060_set_property_16_nocts(uint8_t group, uint8_t prop, uint16_t val) {
-	spi_select();
-	spi_write(CMD_SET_PROPERTY);
-	spi_write(group);
-	spi_write(2);
-	spi_write(prop);
-	spi_write(val >> 8);
-	spi_write(val);
-	spi_deselect();
+uint8_t si4060_set_property_16_nocts(uint8_t group, uint8_t prop, uint16_t val) {
+	if (!si4060_bus_try_select()) {
+		return SI_ERR_BUSY;
+	}
+	si4060_bus_write(CMD_SET_PROPERTY);
+	si4060_last_cmd = CMD_SET_PROPERTY;
+	si4060_bus_write(group);
+	si4060_bus_write(2);
+	si4060_bus_write(prop);
+	si4060_bus_write(val >> 8);
+	si4060_bus_write(val);
+	si4060_bus_deselect();
+	return SI_OK;
 }
 
 /*
@@ -361,16 +695,12 @@ void si4060_set_property_16_nocts(uint8_t group, uint8_t prop, uint16_t val) {
  * val:		the value to set
  */
 void si4060_set_property_24(uint8_t group, uint8_t prop, uint32_t val) {
-	si4060_get_cts(0);
-	spi_select();
-	spi_write(CMD_SET_PROPERTY);
-	spi_write(group);
-	spi_write(3);
-	spi_write(prop);
-	spi_write(val >> 16);
-	spi_write(val >> 8);
-	spi_write(val);
-	spi_deselect();
+	uint8_t vals[3];
+
+	vals[0] = val >> 16;
+	vals[1] = val >> 8;
+	vals[2] = val;
+	si4060_set_properties(group, prop, vals, 3);
 }
 
 /*
@@ -383,17 +713,300 @@ void si4060_set_property_24(uint8_t group, uint8_t prop, uint32_t val) {
  * val:		the value to set
  */
 void si4060_set_property_32(uint8_t group, uint8_t prop, uint32_t val) {
-	si4060_get_cts(0);
-	spi_select();
-	spi_write(CMD_SET_PROPERTY);
-	spi_write(group);
-	spi_write(4);
-	spi_write(prop);
-	spi_write(val >> 24);
-	spi_write(val >> 16);
-	spi_write(val >> 8);
-	spi_write(val);
-	spi_deselect();
+	uint8_t vals[4];
+
+	vals[0] = val >> 24;
+	vals[1] = val >> 16;
+	vals[2] = val >> 8;
+	vals[3] = val;
+	si4060_set_properties(group, prop, vals, 4);
+}
+
+/*
+ * si4060_set_properties
+ *
+ * sets a run of consecutive properties of one group in the Si4060.
+ * the run is split into SET_PROPERTY commands of at most SI_MAX_PROPS
+ * values, so every chunk costs one CTS wait instead of one per property.
+ * each chunk is sent by DMA, the function returns while it is on the bus.
+ * values at the ends of the run that the property shadow already holds
+ * are not sent, a run the radio fully holds sends nothing.
+ * a chunk whose CTS wait times out is not sent and dropped from the shadow.
+ *
+ * group:	the group number of the properties
+ * prop:	the number (index) of the first property
+ * vals:	the values to set, in ascending property order
+ * count:	the number of properties to set
+ *
+ * returns:	SI_OK, or the first error of a CTS wait
+ */
+uint8_t si4060_set_properties(uint8_t group, uint8_t prop, const uint8_t *vals, uint8_t count) {
+	uint8_t n, i, ret = SI_OK;
+
+	while (count && si4060_shadow_hit(group, prop, vals[0])) {
+		prop++;
+		vals++;
+		count--;
+	}
+	while (count && si4060_shadow_hit(group, prop + count - 1, vals[count - 1])) {
+		count--;
+	}
+
+	while (count) {
+		n = (count > SI_MAX_PROPS) ? SI_MAX_PROPS : count;
+		if (si4060_get_cts(0) != SI_OK) {
+			/* not sent, the radio content of these properties is unknown */
+			ret = SI_ERR_CTS_TIMEOUT;
+			for (i = 0; i < n; i++) {
+				si4060_shadow_forget(group, prop + i);
+			}
+			prop += n;
+			vals += n;
+			count -= n;
+			continue;
+		}
+		si4060_cmd_buf[0] = CMD_SET_PROPERTY;
+		si4060_cmd_buf[1] = group;
+		si4060_cmd_buf[2] = n;
+		si4060_cmd_buf[3] = prop;
+		for (i = 0; i < n; i++) {
+			si4060_cmd_buf[4 + i] = vals[i];
+			si4060_shadow_store(group, prop + i, vals[i]);
+		}
+		si4060_send(si4060_cmd_buf, 4 + n);
+		prop += n;
+		vals += n;
+		count -= n;
+	}
+	return ret;
+}
+
+/*
+ * si4060_replay
+ *
+ * sends a precompiled configuration stream (see si4063_cfg.h) to the
+ * Si4060 by DMA, straight from flash, waiting for CTS before every
+ * command and after the last one.
+ * the property shadow is updated with the values the stream sets.
+ * a command whose CTS wait times out is skipped, and what it would have
+ * set is dropped from the shadow.
+ *
+ * cfg:		the stream, records of length and command bytes, 0 terminated
+ *
+ * returns:	SI_OK, or the first error of a CTS wait
+ */
+uint8_t si4060_replay(const uint8_t *cfg) {
+	uint8_t len, i, ret = SI_OK;
+
+	while ((len = *cfg++) != SI_CFG_END) {
+		if (si4060_get_cts(0) != SI_OK) {
+			ret = SI_ERR_CTS_TIMEOUT;
+			if (cfg[0] == CMD_SET_PROPERTY) {
+				for (i = 0; i < cfg[2]; i++) {
+					si4060_shadow_forget(cfg[1], cfg[3] + i);
+				}
+			} else if (cfg[0] == CMD_GPIO_PIN_CFG) {
+				si4060_gpio_shadow_valid = 0;
+			}
+			cfg += len;
+			continue;
+		}
+		si4060_send(cfg, len);
+
+		if (cfg[0] == CMD_SET_PROPERTY) {
+			for (i = 0; i < cfg[2]; i++) {
+				si4060_shadow_store(cfg[1], cfg[3] + i, cfg[4 + i]);
+			}
+		} else if (cfg[0] == CMD_GPIO_PIN_CFG) {
+			for (i = 0; i < sizeof(si4060_gpio_shadow); i++) {
+				si4060_gpio_shadow[i] = cfg[1 + i];
+			}
+			si4060_gpio_shadow_valid = 1;
+			if (si4060_gpio_cfg_cts(cfg[3]) != SI_OK) {
+				ret = SI_ERR_CTS_TIMEOUT;
+			}
+		} else if (cfg[0] == CMD_POWER_UP) {
+			si4060_power = SI_PWR_SPI_ACTIVE;
+		}
+		cfg += len;
+	}
+	if (si4060_get_cts(0) != SI_OK) {
+		ret = SI_ERR_CTS_TIMEOUT;
+	}
+	return ret;
+}
+
+/*
+ * si4060_restore
+ *
+ * writes the GPIO configuration and every shadowed property back into
+ * the Si4060 after a shutdown, in runs of valid shadow entries.
+ * has to be called after si4060_power_up.
+ * a command whose CTS wait times out is not sent and dropped from the
+ * shadow, so the next setter writes it again.
+ *
+ * returns:	SI_OK, or the first error of a CTS wait
+ */
+static uint8_t si4060_restore(void) {
+	uint8_t w, i, n, k, idx, ret = SI_OK;
+
+	if (si4060_gpio_shadow_valid && si4060_get_cts(0) != SI_OK) {
+		ret = SI_ERR_CTS_TIMEOUT;
+		si4060_gpio_shadow_valid = 0;
+	} else if (si4060_gpio_shadow_valid) {
+		si4060_cmd_buf[0] = CMD_GPIO_PIN_CFG;
+		for (i = 0; i < sizeof(si4060_gpio_shadow); i++) {
+			si4060_cmd_buf[1 + i] = si4060_gpio_shadow[i];
+		}
+		si4060_send(si4060_cmd_buf, 1 + sizeof(si4060_gpio_shadow));
+		if (si4060_gpio_cfg_cts(si4060_gpio_shadow[2]) != SI_OK) {
+			ret = SI_ERR_CTS_TIMEOUT;
+		}
+	}
+
+	for (w = 0; w < sizeof(si4060_shadow_map) / sizeof(si4060_shadow_map[0]); w++) {
+		i = 0;
+		while (i < si4060_shadow_map[w][2]) {
+			/* collect the next run of valid entries */
+			n = 0;
+			idx = si4060_shadow_map[w][3] + i;
+			while (i + n < si4060_shadow_map[w][2] && n < SI_MAX_PROPS
+					&& (si4060_shadow_valid[(idx + n) >> 3] & (1 << ((idx + n) & 0x07)))) {
+				n++;
+			}
+			if (!n) {
+				i++;
+				continue;
+			}
+			if (si4060_get_cts(0) != SI_OK) {
+				/* not sent, the radio content of these properties is unknown */
+				ret = SI_ERR_CTS_TIMEOUT;
+				for (k = 0; k < n; k++) {
+					si4060_shadow_forget(si4060_shadow_map[w][0], si4060_shadow_map[w][1] + i + k);
+				}
+				i += n;
+				continue;
+			}
+			si4060_cmd_buf[0] = CMD_SET_PROPERTY;
+			si4060_cmd_buf[1] = si4060_shadow_map[w][0];
+			si4060_cmd_buf[2] = n;
+			si4060_cmd_buf[3] = si4060_shadow_map[w][1] + i;
+			for (k = 0; k < n; k++) {
+				si4060_cmd_buf[4 + k] = si4060_shadow[idx + k];
+			}
+			si4060_send(si4060_cmd_buf, 4 + n);
+			i += n;
+		}
+	}
+	return ret;
+}
+
+/*
+ * si4060_set_power
+ *
+ * moves the Si4060 into a power state (SI_PWR_x). SHUTDOWN keeps the
+ * property shadow, leaving it powers the radio up and restores all
+ * registers. the time of every wake up to TX_TUNE is measured for
+ * si4060_power_for_deadline.
+ *
+ * state:	the power state, TX is entered by si4060_start_tx
+ *
+ * returns:	SI_OK, or the first error of a CTS wait
+ */
+uint8_t si4060_set_power(uint8_t state) {
+	uint8_t from = si4060_power, ret = SI_OK;
+	uint32_t start;
+
+	if (state == from) {
+		return SI_OK;
+	}
+	if (state == SI_PWR_SHUTDOWN) {
+		si4060_sdn();
+		return SI_OK;
+	}
+
+	start = si4060_bus_cycles();
+	if (from == SI_PWR_SHUTDOWN) {
+		si4060_wakeup();
+		si4060_power_up();
+		ret = si4060_restore();
+	}
+	if (si4060_change_state(state) != SI_OK) {
+		ret = SI_ERR_CTS_TIMEOUT;
+	}
+	if (si4060_get_cts(0) != SI_OK) {
+		ret = SI_ERR_CTS_TIMEOUT;
+	}
+
+	if (state == SI_PWR_TX_TUNE && ret == SI_OK) {
+		si4060_wake_us[from] = (si4060_bus_cycles() - start) / (SystemCoreClock / 1000000);
+	}
+	return ret;
+}
+
+uint8_t si4060_get_power(void) {
+	return si4060_power;
+}
+
+/*
+ * si4060_power_for_deadline
+ *
+ * us:		time until the radio has to be ready to transmit
+ *
+ * returns:	the lowest power state that wakes up to TX_TUNE within us,
+ * 		with SI_WAKE_MARGIN_US to spare
+ */
+uint8_t si4060_power_for_deadline(uint32_t us) {
+	static const uint8_t states[] = {
+		SI_PWR_SHUTDOWN, SI_PWR_STANDBY, SI_PWR_SPI_ACTIVE, SI_PWR_READY,
+	};
+	uint8_t i;
+
+	for (i = 0; i < sizeof(states); i++) {
+		if (si4060_wake_us[states[i]] + SI_WAKE_MARGIN_US <= us) {
+			return states[i];
+		}
+	}
+	return SI_PWR_TX_TUNE;
+}
+
+/*
+ * si4060_set_freq_control
+ *
+ * sets the integer and fractional divider of the synthesizer with a single
+ * SET_PROPERTY command (FREQ_CONTROL_INTE and FREQ_CONTROL_FRAC are adjacent)
+ *
+ * inte:	the integer divider
+ * frac:	the 20 bit fractional divider
+ */
+void si4060_set_freq_control(uint8_t inte, uint32_t frac) {
+	uint8_t vals[4];
+
+	vals[0] = inte;
+	vals[1] = frac >> 16;
+	vals[2] = frac >> 8;
+	vals[3] = frac;
+	si4060_set_properties(PROP_FREQ_CONTROL, FREQ_CONTROL_INTE, vals, 4);
+}
+
+/*
+ * si4060_set_freq_dev
+ *
+ * sets the frequency deviation and the deviation offset with a single
+ * SET_PROPERTY command (MODEM_FREQ_DEV and MODEM_FREQ_OFFSET are adjacent)
+ *
+ * dev:		the 17 bit frequency deviation
+ * offset:	the frequency deviation offset
+ */
+void si4060_set_freq_dev(uint32_t dev, uint16_t offset) {
+	uint8_t vals[5];
+
+	vals[0] = dev >> 16;
+	vals[1] = dev >> 8;
+	vals[2] = dev;
+	vals[3] = offset >> 8;
+	vals[4] = offset;
+	si4060_set_properties(PROP_MODEM, MODEM_FREQ_DEV, vals, 5);
 }
 
 /*
@@ -408,37 +1021,43 @@ void si4060_set_property_32(uint8_t group, uint8_t prop, uint32_t val) {
  * - Rearranged early functions
  * - Changes gpio pin assignment
  * - changes TXCO Global Tune value from 0x00 to 0x62 for capacitance
+ * - GPIO2 signals CTS to the MCU instead of the divided clock
+ * - writes INT_CTL and FRR_CTL in their own groups; these used to land on
+ *   GLOBAL_CLK_CFG and GLOBAL_CONFIG and clear them again
  */
 void si4060_setup(uint8_t mod_type) {
+	uint8_t vals[7];
+
 	/* set up GPIOs */
 	si4060_gpio_pin_cfg(GPIO_MODE_TX_DATA_CLK,
 			GPIO_MODE_EN_PA,
-			GPIO_MODE_DIV_CLK,
+			GPIO_MODE_CTS,
 			GPIO_MODE_INPUTPIN,
 			DRV_STRENGTH_HIGH);
 
-#ifdef	USE_TCXO
-	si4060_set_property_8(PROP_GLOBAL,
-			GLOBAL_XO_TUNE,
-			0x62);
-#endif
-
 	/* Global clock config */
+#ifdef	USE_TCXO
+	vals[0] = 0x62;
+	vals[1] = 0x60;
+	si4060_set_properties(PROP_GLOBAL, GLOBAL_XO_TUNE, vals, 2);
+#else
 	si4060_set_property_8(PROP_GLOBAL,
 			GLOBAL_CLK_CFG,
 			0x60);
+#endif
 
 	/* set high performance mode */
 	si4060_set_property_8(PROP_GLOBAL,
 			GLOBAL_CONFIG,
 			GLOBAL_RESERVED | POWER_MODE_HIGH_PERF | SEQUENCER_MODE_FAST);
 
-	/* PROP_INT_CTL */
-	si4060_set_property_8(PROP_GLOBAL,
-			PROP_INT_CTL, 0x00);
+	/* disable all interrupts */
+	si4060_set_property_8(PROP_INT_CTL,
+			INT_CTL_ENABLE, 0x00);
 
-	si4060_set_property_32(PROP_GLOBAL,
-			PROP_FRR_CTL, 0x00000000);
+	/* disable all fast response registers */
+	si4060_set_property_32(PROP_FRR_CTL,
+			FRR_CTL_A_MODE, 0x00000000);
 
 	/* disable preamble */
 	si4060_set_property_8(PROP_PREAMBLE,
@@ -450,23 +1069,22 @@ void si4060_setup(uint8_t mod_type) {
 			MODEM_MOD_TYPE,
 			MOD_DIRECT_MODE_SYNC | MOD_GPIO_3 | MOD_SOURCE_DIRECT | (mod_type & 0x07));
 
-	/* setup the NCO data rate for APRS */
-	si4060_set_property_24(PROP_MODEM,
-			MODEM_DATA_RATE,
-			RF_MOD_APRS_SR);
+	/* setup the NCO data rate for APRS, followed by the NCO modulo
+	 * and oversampling mode */
+	vals[0] = (uint8_t)((uint32_t)RF_MOD_APRS_SR >> 16);
+	vals[1] = (uint8_t)((uint32_t)RF_MOD_APRS_SR >> 8);
+	vals[2] = (uint8_t)((uint32_t)RF_MOD_APRS_SR);
+	vals[3] = (uint8_t)((uint32_t)(MOD_TX_OSR_10 | (XO_FREQ / 10)) >> 24);
+	vals[4] = (uint8_t)((uint32_t)(MOD_TX_OSR_10 | (XO_FREQ / 10)) >> 16);
+	vals[5] = (uint8_t)((uint32_t)(MOD_TX_OSR_10 | (XO_FREQ / 10)) >> 8);
+	vals[6] = (uint8_t)((uint32_t)(MOD_TX_OSR_10 | (XO_FREQ / 10)));
+	si4060_set_properties(PROP_MODEM, MODEM_DATA_RATE, vals, 7);
 
 	/* do not transmit sync word */
 	si4060_set_property_8(PROP_SYNC,
 			SYNC_CONFIG,
 			SYNC_NO_XMIT);
 
-	/* setup the NCO modulo and oversampling mode */
-	si4060_set_property_32(PROP_MODEM,
-			MODEM_TX_NCO_MOD,
-			MOD_TX_OSR_10 | (XO_FREQ / 10));
-
-
-
 	/* set up the PA duty cycle */
 	si4060_set_property_8(PROP_PA,
 			PA_BIAS_CLKDUTY,
@@ -488,35 +1106,17 @@ void si4060_set_filter(void) {
 	//uint8_t coeff[9] = {0xfa, 0xe5, 0xd8, 0xde, 0xf8, 0x21, 0x4f, 0x71, 0x7f};	// LP only, 2400 Hz
 	//uint8_t coeff[9] = {0xd9, 0xf1, 0x0c, 0x29, 0x44, 0x5d, 0x70, 0x7c, 0x7f}; 	// LP only, 4800 Hz
 	//uint8_t coeff[9] = {0xd5, 0xe9, 0x03, 0x20, 0x3d, 0x58, 0x6d, 0x7a, 0x7f}; 	// LP only, 4400 Hz
-	uint8_t coeff[9] = {0x81, 0x9f, 0xc4, 0xee, 0x18, 0x3e, 0x5c, 0x70, 0x76};	// 6dB@1200Hz, 4400 Hz (bad stopband)
+	uint8_t coeff[9] = {SI_TX_FILTER_COEFF};
+	uint8_t vals[9];
+	uint8_t i;
 
-	si4060_set_property_8(PROP_MODEM,
+	/* COEFF_8 has the lowest property number, so the run is written reversed */
+	for (i = 0; i < 9; i++) {
+		vals[i] = coeff[8 - i];
+	}
+	si4060_set_properties(PROP_MODEM,
 			MODEM_TX_FILTER_COEFF_8,
-			coeff[8]);
-	si4060_set_property_8(PROP_MODEM,
-			MODEM_TX_FILTER_COEFF_7,
-			coeff[7]);
-	si4060_set_property_8(PROP_MODEM,
-			MODEM_TX_FILTER_COEFF_6,
-			coeff[6]);
-	si4060_set_property_8(PROP_MODEM,
-			MODEM_TX_FILTER_COEFF_5,
-			coeff[5]);
-	si4060_set_property_8(PROP_MODEM,
-			MODEM_TX_FILTER_COEFF_4,
-			coeff[4]);
-	si4060_set_property_8(PROP_MODEM,
-			MODEM_TX_FILTER_COEFF_3,
-			coeff[3]);
-	si4060_set_property_8(PROP_MODEM,
-			MODEM_TX_FILTER_COEFF_2,
-			coeff[2]);
-	si4060_set_property_8(PROP_MODEM,
-			MODEM_TX_FILTER_COEFF_1,
-			coeff[1]);
-	si4060_set_property_8(PROP_MODEM,
-			MODEM_TX_FILTER_COEFF_0,
-			coeff[0]);
+			vals, 9);
 }
 
 /*
@@ -530,17 +1130,30 @@ void si4060_set_filter(void) {
  */
 void si4060_gpio_pin_cfg(uint8_t gpio0, uint8_t gpio1,
 		uint8_t gpio2, uint8_t gpio3, uint8_t drvstrength) {
+	uint8_t args[7] = {gpio0, gpio1, gpio2, gpio3,
+			NIRQ_MODE_DONOTHING, GPIO_MODE_SDO, drvstrength};
+	uint8_t i, same = si4060_gpio_shadow_valid;
+
+	for (i = 0; i < sizeof(args); i++) {
+		if (si4060_gpio_shadow[i] != args[i]) {
+			same = 0;
+		}
+		si4060_gpio_shadow[i] = args[i];
+	}
+	if (same) {
+		return;
+	}
+	si4060_gpio_shadow_valid = 1;
+
 	si4060_get_cts(0);
-	spi_select();
-	spi_write(CMD_GPIO_PIN_CFG);
-	spi_write(gpio0);
-	spi_write(gpio1);
-	spi_write(gpio2);
-	spi_write(gpio3);
-	spi_write(NIRQ_MODE_DONOTHING);
-	spi_write(GPIO_MODE_SDO);
-	spi_write(drvstrength);
-	spi_deselect();
+	si4060_bus_select();
+	si4060_bus_write(CMD_GPIO_PIN_CFG);
+	si4060_last_cmd = CMD_GPIO_PIN_CFG;
+	for (i = 0; i < sizeof(args); i++) {
+		si4060_bus_write(args[i]);
+	}
+	si4060_bus_deselect();
+	si4060_gpio_cfg_cts(gpio2);
 }
 
 void si4060_set_aprs_params(void) {
@@ -552,14 +1165,8 @@ void si4060_set_aprs_params(void) {
 	si4060_set_property_8(PROP_MODEM,
 			MODEM_CLKGEN_BAND,
 			SY_SEL_1 | FVCO_DIV_24);
-	/* setup frequency deviation offset */
-	si4060_set_property_16(PROP_MODEM,
-			MODEM_FREQ_OFFSET,
-			0);
-	/* setup frequency deviation */
-	si4060_set_property_24(PROP_MODEM,
-			MODEM_FREQ_DEV,
-			(uint16_t)(2*FDEV_APRS));
+	/* setup frequency deviation and deviation offset */
+	si4060_set_freq_dev((uint16_t)(2*FDEV_APRS), 0);
 }
 
 
@@ -572,139 +1179,46 @@ void si4060_set_aprs_params_TESTING(void) {
 	si4060_set_property_8(PROP_MODEM,
 			MODEM_CLKGEN_BAND,
 			SY_SEL_1 | FVCO_DIV_10);
-	/* setup frequency deviation offset */
-	si4060_set_property_16(PROP_MODEM,
-			MODEM_FREQ_OFFSET,
-			0);
-	/* setup frequency deviation */
-	si4060_set_property_24(PROP_MODEM,
-			MODEM_FREQ_DEV,
-			(uint16_t)(2*FDEV_APRS_DFM));
+	/* setup frequency deviation and deviation offset */
+	si4060_set_freq_dev((uint16_t)(2*FDEV_APRS_DFM), 0);
 }
 
 
 
 void si4060_freq_aprs_reg1(void) {
-	si4060_set_aprs_params();
-	/* set up the integer divider */
-	si4060_set_property_8(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_INTE,
-			(uint8_t)(FDIV_INTE_2M(EU)));
-	/* set up the fractional divider */
-	si4060_set_property_24(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_FRAC,
-			(uint32_t)(FDIV_FRAC_2M(EU)));
+	si4060_replay(si4060_cfg_aprs_reg1);
 }
 
 void si4060_freq_aprs_reg2(void) {
-	si4060_set_aprs_params();
-	/* set up the integer divider */
-	si4060_set_property_8(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_INTE,
-			(uint8_t)(FDIV_INTE_2M(US)));
-	/* set up the fractional divider */
-	si4060_set_property_24(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_FRAC,
-			(uint32_t)(FDIV_FRAC_2M(US)));
+	si4060_replay(si4060_cfg_aprs_reg2);
 }
 
 void si4060_freq_aprs_cn(void) {
-	si4060_set_aprs_params();
-	/* set up the integer divider */
-	si4060_set_property_8(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_INTE,
-			(uint8_t)(FDIV_INTE_2M(CN)));
-	/* set up the fractional divider */
-	si4060_set_property_24(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_FRAC,
-			(uint32_t)(FDIV_FRAC_2M(CN)));
+	si4060_replay(si4060_cfg_aprs_cn);
 }
 
 void si4060_freq_aprs_jp(void) {
-	si4060_set_aprs_params();
-	/* set up the integer divider */
-	si4060_set_property_8(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_INTE,
-			(uint8_t)(FDIV_INTE_2M(JP)));
-	/* set up the fractional divider */
-	si4060_set_property_24(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_FRAC,
-			(uint32_t)(FDIV_FRAC_2M(JP)));
+	si4060_replay(si4060_cfg_aprs_jp);
 }
 
 void si4060_freq_aprs_thai(void) {
-	si4060_set_aprs_params();
-	/* set up the integer divider */
-	si4060_set_property_8(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_INTE,
-			(uint8_t)(FDIV_INTE_2M(THAI)));
-	/* set up the fractional divider */
-	si4060_set_property_24(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_FRAC,
-			(uint32_t)(FDIV_FRAC_2M(THAI)));
+	si4060_replay(si4060_cfg_aprs_thai);
 }
 
 void si4060_freq_aprs_nz(void) {
-	si4060_set_aprs_params();
-	/* set up the integer divider */
-	si4060_set_property_8(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_INTE,
-			(uint8_t)(FDIV_INTE_2M(NZ)));
-	/* set up the fractional divider */
-	si4060_set_property_24(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_FRAC,
-			(uint32_t)(FDIV_FRAC_2M(NZ)));
+	si4060_replay(si4060_cfg_aprs_nz);
 }
 
 void si4060_freq_aprs_aus(void) {
-	si4060_set_aprs_params();
-	/* set up the integer divider */
-	si4060_set_property_8(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_INTE,
-			(uint8_t)(FDIV_INTE_2M(AUS)));
-	/* set up the fractional divider */
-	si4060_set_property_24(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_FRAC,
-			(uint32_t)(FDIV_FRAC_2M(AUS)));
+	si4060_replay(si4060_cfg_aprs_aus);
 }
 
 void si4060_freq_aprs_brazil(void) {
-	si4060_set_aprs_params();
-	/* set up the integer divider */
-	si4060_set_property_8(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_INTE,
-			(uint8_t)(FDIV_INTE_2M(BRAZIL)));
-	/* set up the fractional divider */
-	si4060_set_property_24(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_FRAC,
-			(uint32_t)(FDIV_FRAC_2M(BRAZIL)));
+	si4060_replay(si4060_cfg_aprs_brazil);
 }
 
 void si4060_freq_2m_rtty(void) {
-	/* use 2FSK from async GPIO0 */
-	si4060_set_property_8(PROP_MODEM,
-			MODEM_MOD_TYPE,
-			MOD_TYPE_2FSK | MOD_SOURCE_DIRECT | MOD_GPIO_3 | MOD_DIRECT_MODE_ASYNC);
-	/* setup divider to 24 (for 2m-band) */
-	si4060_set_property_8(PROP_MODEM,
-			MODEM_CLKGEN_BAND,
-			SY_SEL_1 | FVCO_DIV_24);
-	/* set up the integer divider */
-	si4060_set_property_8(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_INTE,
-			(uint8_t)(FDIV_INTE_2M(RTTY)));
-	/* set up the fractional divider */
-	si4060_set_property_24(PROP_FREQ_CONTROL,
-			FREQ_CONTROL_FRAC,
-			(uint32_t)(FDIV_FRAC_2M(RTTY)));
-	/* setup frequency deviation offset */
-	si4060_set_property_16(PROP_MODEM,
-			MODEM_FREQ_OFFSET,
-			0);
-	/* setup frequency deviation */
-	si4060_set_property_24(PROP_MODEM,
-			MODEM_FREQ_DEV,
-			(uint16_t)(FDEV_RTTY));
+	si4060_replay(si4060_cfg_2m_rtty);
 }
 
 
@@ -0,0 +1,95 @@
+/**
+  ******************************************************************************
+  * @file    si4063_bus.c
+  * @brief   This file contains the DFM17 implementation of the Si4063 bus
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  */
+
+#include "si4063_bus.h"
+#include "main.h"
+#include "spi.h"
+#include "tim.h"
+
+/* the single DMA command burst in flight, see si4060_bus_send */
+static spi_xfer si4060_bus_xfer;
+
+void si4060_bus_select(void) {
+	spi_select();
+}
+
+uint8_t si4060_bus_try_select(void) {
+	return spi_try_select();
+}
+
+void si4060_bus_deselect(void) {
+	spi_deselect();
+}
+
+void si4060_bus_write(uint8_t data) {
+	spi_write(data);
+}
+
+uint8_t si4060_bus_read(void) {
+	return spi_read();
+}
+
+/*
+ * si4060_bus_send
+ *
+ * sends one complete command framed by nSEL, by DMA. returns while the
+ * command is on the bus, cmd has to stay valid until si4060_bus_wait
+ * (every select waits for it as well).
+ */
+void si4060_bus_send(const uint8_t *cmd, uint8_t len) {
+	si4060_bus_xfer.tx = cmd;
+	si4060_bus_xfer.rx = NULL;
+	si4060_bus_xfer.len = len;
+	si4060_bus_xfer.done = NULL;
+	spi_xfer_submit(&si4060_bus_xfer);
+}
+
+void si4060_bus_wait(void) {
+	spi_xfer_wait();
+}
+
+void si4060_bus_sdn(uint8_t shutdown) {
+	// SDN is PC3
+	if (shutdown) {
+		GPIOC->BSRR = (1U << +3);
+	} else {
+		GPIOC->BSRR = (1U << (16+3));
+	}
+}
+
+/* GPIO2 of the Si4063 is on PD0 */
+uint8_t si4060_bus_cts(void) {
+	return (oSpiGPIO2_GPIO_Port->IDR & oSpiGPIO2_Pin) != 0;
+}
+
+void si4060_bus_delay_us(uint16_t us) {
+	delay_us(us);
+}
+
+/* core clock cycles, SystemCoreClock per second */
+uint32_t si4060_bus_cycles(void) {
+	return getCycleCount();
+}
@@ -0,0 +1,116 @@
+/**
+  ******************************************************************************
+  * @file    si4063_cfg.c
+  * @brief   This file contains the precompiled Si4063 configuration streams
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  */
+
+#include "si4063_cfg.h"
+
+/* the filter registers run from COEFF_8 up to COEFF_0 */
+#define SI_CFG_REV9(c0, c1, c2, c3, c4, c5, c6, c7, c8) \
+	c8, c7, c6, c5, c4, c3, c2, c1, c0
+#define SI_CFG_FILTER(coeff)	SI_CFG_REV9(coeff)
+
+const uint8_t si4060_cfg_setup[] = {
+	/* power up with the TCXO / crystal at XO_FREQ */
+	7, CMD_POWER_UP, FUNC,
+#ifdef USE_TCXO
+	TCXO,
+#else
+	0,
+#endif
+	SI_CFG_U32(XO_FREQ),
+
+	8, CMD_GPIO_PIN_CFG,
+	GPIO_MODE_TX_DATA_CLK, GPIO_MODE_EN_PA, GPIO_MODE_CTS, GPIO_MODE_INPUTPIN,
+	NIRQ_MODE_DONOTHING, GPIO_MODE_SDO, DRV_STRENGTH_HIGH,
+
+	/* global clock config */
+#ifdef USE_TCXO
+	SI_CFG_SET_PROPERTY(PROP_GLOBAL, GLOBAL_XO_TUNE, 2), 0x62, 0x60,
+#else
+	SI_CFG_SET_PROPERTY(PROP_GLOBAL, GLOBAL_CLK_CFG, 1), 0x60,
+#endif
+	SI_CFG_SET_PROPERTY(PROP_GLOBAL, GLOBAL_CONFIG, 1),
+	GLOBAL_RESERVED | POWER_MODE_HIGH_PERF | SEQUENCER_MODE_FAST,
+
+	/* no interrupts, no fast response registers */
+	SI_CFG_SET_PROPERTY(PROP_INT_CTL, INT_CTL_ENABLE, 1), 0x00,
+	SI_CFG_SET_PROPERTY(PROP_FRR_CTL, FRR_CTL_A_MODE, 4), SI_CFG_U32(0),
+
+	SI_CFG_SET_PROPERTY(PROP_PREAMBLE, PREAMBLE_TX_LENGTH, 1), 0,
+
+	SI_CFG_SET_PROPERTY(PROP_MODEM, MODEM_MOD_TYPE, 1),
+	MOD_DIRECT_MODE_SYNC | MOD_GPIO_3 | MOD_SOURCE_DIRECT | MOD_TYPE_2GFSK,
+	SI_CFG_SET_PROPERTY(PROP_MODEM, MODEM_DATA_RATE, 7),
+	SI_CFG_U24(RF_MOD_APRS_SR), SI_CFG_U32(MOD_TX_OSR_10 | (XO_FREQ / 10)),
+
+	SI_CFG_SET_PROPERTY(PROP_SYNC, SYNC_CONFIG, 1), SYNC_NO_XMIT,
+
+	SI_CFG_SET_PROPERTY(PROP_PA, PA_BIAS_CLKDUTY, 1), PA_BIAS_CLKDUTY_SIN_25,
+
+	SI_CFG_SET_PROPERTY(PROP_MODEM, MODEM_TX_FILTER_COEFF_8, 9),
+	SI_CFG_FILTER(SI_TX_FILTER_COEFF),
+
+	SI_CFG_END
+};
+
+/* 2GFSK direct sync mode, FREQ_DEV / FREQ_OFFSET and INTE / FRAC */
+#define SI_CFG_APRS(fvco_div, dev, inte, frac) \
+	SI_CFG_SET_PROPERTY(PROP_MODEM, MODEM_MOD_TYPE, 1), \
+	MOD_TYPE_2GFSK | MOD_SOURCE_DIRECT | MOD_GPIO_3 | MOD_DIRECT_MODE_SYNC, \
+	SI_CFG_SET_PROPERTY(PROP_MODEM, MODEM_CLKGEN_BAND, 1), SY_SEL_1 | (fvco_div), \
+	SI_CFG_SET_PROPERTY(PROP_MODEM, MODEM_FREQ_DEV, 5), \
+	SI_CFG_U24((uint16_t)(dev)), SI_CFG_U16(0), \
+	SI_CFG_SET_PROPERTY(PROP_FREQ_CONTROL, FREQ_CONTROL_INTE, 4), \
+	SI_CFG_U8(inte), SI_CFG_U24(frac), \
+	SI_CFG_END
+
+#define SI_CFG_APRS_2M(region) \
+	SI_CFG_APRS(FVCO_DIV_24, 2*FDEV_APRS, \
+			FDIV_INTE_2M(region), FDIV_FRAC_2M(region))
+
+const uint8_t si4060_cfg_aprs_dfm17[] = {
+	SI_CFG_APRS(FVCO_DIV_10, 2*FDEV_APRS_DFM, FDIV_INTE_DFM, FDEV_DFM)
+};
+
+const uint8_t si4060_cfg_aprs_reg1[] = { SI_CFG_APRS_2M(EU) };
+const uint8_t si4060_cfg_aprs_reg2[] = { SI_CFG_APRS_2M(US) };
+const uint8_t si4060_cfg_aprs_cn[] = { SI_CFG_APRS_2M(CN) };
+const uint8_t si4060_cfg_aprs_jp[] = { SI_CFG_APRS_2M(JP) };
+const uint8_t si4060_cfg_aprs_thai[] = { SI_CFG_APRS_2M(THAI) };
+const uint8_t si4060_cfg_aprs_nz[] = { SI_CFG_APRS_2M(NZ) };
+const uint8_t si4060_cfg_aprs_aus[] = { SI_CFG_APRS_2M(AUS) };
+const uint8_t si4060_cfg_aprs_brazil[] = { SI_CFG_APRS_2M(BRAZIL) };
+
+/* 2FSK async direct mode for RTTY */
+const uint8_t si4060_cfg_2m_rtty[] = {
+	SI_CFG_SET_PROPERTY(PROP_MODEM, MODEM_MOD_TYPE, 1),
+	MOD_TYPE_2FSK | MOD_SOURCE_DIRECT | MOD_GPIO_3 | MOD_DIRECT_MODE_ASYNC,
+	SI_CFG_SET_PROPERTY(PROP_MODEM, MODEM_CLKGEN_BAND, 1), SY_SEL_1 | FVCO_DIV_24,
+	SI_CFG_SET_PROPERTY(PROP_FREQ_CONTROL, FREQ_CONTROL_INTE, 4),
+	SI_CFG_U8(FDIV_INTE_2M(RTTY)), SI_CFG_U24(FDIV_FRAC_2M(RTTY)),
+	SI_CFG_SET_PROPERTY(PROP_MODEM, MODEM_FREQ_DEV, 5),
+	SI_CFG_U24((uint16_t)(FDEV_RTTY)), SI_CFG_U16(0),
+	SI_CFG_END
+};
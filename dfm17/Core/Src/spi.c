@@ -31,6 +31,14 @@
 
 /* USER CODE BEGIN 0 */
 
+/* SPI1 DMA, runs the queued radio transactions (see spi_xfer_submit) */
+DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_spi1_tx;
+
+/* head is the transaction on the bus, NULL when the queue is idle */
+static spi_xfer * volatile spi_xfer_head;
+static spi_xfer *spi_xfer_tail;
+
 /* USER CODE END 0 */
 
 SPI_HandleTypeDef hspi1;
@@ -53,7 +61,7 @@ void MX_SPI1_Init(void)
   hspi1.Init.CLKPolarity = SPI_POLARITY_LOW;
   hspi1.Init.CLKPhase = SPI_PHASE_1EDGE;
   hspi1.Init.NSS = SPI_NSS_SOFT;
-  hspi1.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_32;
+  hspi1.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_2;
   hspi1.Init.FirstBit = SPI_FIRSTBIT_MSB;
   hspi1.Init.TIMode = SPI_TIMODE_DISABLE;
   hspi1.Init.CRCCalculation = SPI_CRCCALCULATION_DISABLE;
@@ -88,7 +96,7 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef* spiHandle)
     */
     GPIO_InitStruct.Pin = oSpiSCLK_Pin|oSpiMOSI_Pin;
     GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
     HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
     GPIO_InitStruct.Pin = oSpiMISO_Pin;
@@ -98,6 +106,45 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef* spiHandle)
 
   /* USER CODE BEGIN SPI1_MspInit 1 */
 
+    /* SPI1 DMA Init */
+    /* SPI1_RX Init */
+    hdma_spi1_rx.Instance = DMA1_Channel2;
+    hdma_spi1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_spi1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi1_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi1_rx.Init.Mode = DMA_NORMAL;
+    hdma_spi1_rx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    if (HAL_DMA_Init(&hdma_spi1_rx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(spiHandle,hdmarx,hdma_spi1_rx);
+
+    /* SPI1_TX Init */
+    hdma_spi1_tx.Instance = DMA1_Channel3;
+    hdma_spi1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_spi1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi1_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi1_tx.Init.Mode = DMA_NORMAL;
+    hdma_spi1_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    if (HAL_DMA_Init(&hdma_spi1_tx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(spiHandle,hdmatx,hdma_spi1_tx);
+
+    /* DMA1_Channel2_IRQn, DMA1_Channel3_IRQn interrupt configuration */
+    HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+    HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+
   /* USER CODE END SPI1_MspInit 1 */
   }
 }
@@ -122,6 +169,12 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef* spiHandle)
 
   /* USER CODE BEGIN SPI1_MspDeInit 1 */
 
+    /* SPI1 DMA DeInit */
+    HAL_DMA_DeInit(spiHandle->hdmarx);
+    HAL_DMA_DeInit(spiHandle->hdmatx);
+    HAL_NVIC_DisableIRQ(DMA1_Channel2_IRQn);
+    HAL_NVIC_DisableIRQ(DMA1_Channel3_IRQn);
+
   /* USER CODE END SPI1_MspDeInit 1 */
   }
 }
@@ -201,10 +254,29 @@ uint8_t SpiReadWrite (uint8_t byte) {
 }
 
 void spi_select(void) {
+	// polled access must not run into a queued DMA transaction
+	spi_xfer_wait();
     // nSEL/CS is PB2
 	GPIOB-> BSRR = (1U << (16+2));
 }
 
+/*
+ * spi_try_select
+ *
+ * selects the radio for polled access without waiting, for interrupt
+ * handlers that may have preempted a DMA transaction or a polled access.
+ *
+ * returns:	1 if selected, 0 if the bus is in use
+ */
+uint8_t spi_try_select(void) {
+	// nSEL/CS is PB2, low while a polled access is in progress
+	if (spi_xfer_head || !(GPIOB->ODR & (1U << 2))) {
+		return 0;
+	}
+	GPIOB-> BSRR = (1U << (16+2));
+	return 1;
+}
+
 void spi_deselect(void) {
 	// nSEL/CS is PB2
 	GPIOB-> BSRR = (1U << (2));
@@ -218,4 +290,117 @@ uint8_t spi_read(void) {
 	return SpiReadWrite(0xFF);
 }
 
+/*
+ * spi_set_prescaler
+ *
+ * changes the SPI1 clock divider on the fly, e.g. for time critical transfers.
+ * the BR bits may only be written while the peripheral is disabled.
+ *
+ * prescaler:	one of SPI_BAUDRATEPRESCALER_x
+ */
+void spi_set_prescaler(uint32_t prescaler) {
+	while (((SPI1->SR)&(1<<7))) {};  // wait for BSY bit to Reset
+	__HAL_SPI_DISABLE(&hspi1);
+	MODIFY_REG(SPI1->CR1, SPI_CR1_BR, prescaler);
+	__HAL_SPI_ENABLE(&hspi1);
+}
+
+/*
+ * spi_xfer_start
+ *
+ * selects the radio and hands one transaction to the SPI1 DMA channels
+ */
+static void spi_xfer_start(spi_xfer *xfer) {
+	// nSEL/CS is PB2
+	GPIOB-> BSRR = (1U << (16+2));
+	if (xfer->rx) {
+		HAL_SPI_TransmitReceive_DMA(&hspi1, (uint8_t *)xfer->tx, xfer->rx, xfer->len);
+	} else {
+		HAL_SPI_Transmit_DMA(&hspi1, (uint8_t *)xfer->tx, xfer->len);
+	}
+}
+
+/*
+ * spi_xfer_complete
+ *
+ * called from the DMA interrupt when the transaction on the bus has ended.
+ * deselects the radio, starts the next queued transaction and then reports
+ * the finished one, so the callback may already submit a new transaction.
+ */
+static void spi_xfer_complete(void) {
+	spi_xfer *xfer = spi_xfer_head;
+
+	// nSEL/CS is PB2
+	GPIOB-> BSRR = (1U << (2));
+	spi_xfer_head = xfer->next;
+	if (spi_xfer_head) {
+		spi_xfer_start(spi_xfer_head);
+	} else {
+		spi_xfer_tail = NULL;
+	}
+	if (xfer->done) {
+		xfer->done(xfer);
+	}
+}
+
+/*
+ * spi_xfer_submit
+ *
+ * queues a transaction on SPI1. every transaction is framed by its own
+ * nSEL low/high and runs by DMA, the caller keeps the buffers and the
+ * spi_xfer itself untouched until the done callback has been called.
+ * can be called from the done callback of another transaction.
+ *
+ * xfer:	the transaction, tx / rx / len / done have to be set up
+ */
+void spi_xfer_submit(spi_xfer *xfer) {
+	uint32_t primask = __get_PRIMASK();
+
+	xfer->next = NULL;
+	__disable_irq();
+	if (spi_xfer_head) {
+		spi_xfer_tail->next = xfer;
+		spi_xfer_tail = xfer;
+	} else {
+		spi_xfer_head = xfer;
+		spi_xfer_tail = xfer;
+		spi_xfer_start(xfer);
+	}
+	__set_PRIMASK(primask);
+}
+
+uint8_t spi_xfer_busy(void) {
+	return spi_xfer_head != NULL;
+}
+
+/*
+ * spi_xfer_wait
+ *
+ * blocks until all queued transactions are done.
+ * must not be called from a done callback.
+ */
+void spi_xfer_wait(void) {
+	while (spi_xfer_head) {
+	}
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
+	if (hspi->Instance == SPI1) {
+		spi_xfer_complete();
+	}
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+	if (hspi->Instance == SPI1) {
+		spi_xfer_complete();
+	}
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+	/* drop the transaction, the queue has to keep going */
+	if (hspi->Instance == SPI1 && spi_xfer_head) {
+		spi_xfer_complete();
+	}
+}
+
 /* USER CODE END 1 */
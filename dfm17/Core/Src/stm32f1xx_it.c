@@ -33,6 +33,7 @@
 /* USER CODE BEGIN Includes */
 #include "led.h"
 #include "gps.h"
+#include "GNSS.h"
 #include "si4063.h"
 /* USER CODE END Includes */
 
@@ -76,6 +77,10 @@ extern DMA_HandleTypeDef hdma_usart2_rx;
 extern DMA_HandleTypeDef hdma_usart2_tx;
 extern UART_HandleTypeDef huart2;
 /* USER CODE BEGIN EV */
+extern DMA_HandleTypeDef hdma_tim15_up;
+extern DMA_HandleTypeDef hdma_spi1_rx;
+extern DMA_HandleTypeDef hdma_spi1_tx;
+extern GNSS_StateHandle GNSS_Handle;
 
 /* USER CODE END EV */
 
@@ -211,6 +216,7 @@ void SysTick_Handler(void)
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
+  GNSS_Tick(&GNSS_Handle);
 
   /* USER CODE END SysTick_IRQn 1 */
 }
@@ -338,6 +344,30 @@ void TIM7_IRQHandler(void)
 
 /* USER CODE BEGIN 1 */
 
+/**
+  * @brief This function handles DMA1 channel2 global interrupt (SPI1 RX, radio).
+  */
+void DMA1_Channel2_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_spi1_rx);
+}
+
+/**
+  * @brief This function handles DMA1 channel3 global interrupt (SPI1 TX, radio).
+  */
+void DMA1_Channel3_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_spi1_tx);
+}
+
+/**
+  * @brief This function handles DMA1 channel5 global interrupt (TIM15 update, AFSK waveform).
+  */
+void DMA1_Channel5_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_tim15_up);
+}
+
 // EXTI Line9 External Interrupt ISR Handler CallBackFun
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
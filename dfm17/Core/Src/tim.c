@@ -32,10 +32,14 @@
 /* USER CODE BEGIN 0 */
 
 #include "aprs.h"
+#include "afsk.h"
 extern volatile uint16_t aprs_bit;
 extern volatile uint16_t aprs_tick;
 extern volatile uint16_t aprs_baud_tick;
 
+/* TIM15 update DMA, streams the AFSK waveform to GPIO3 (see afsk.c) */
+DMA_HandleTypeDef hdma_tim15_up;
+
 
 /* USER CODE END 0 */
 
@@ -151,6 +155,9 @@ void MX_TIM15_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN TIM15_Init 2 */
+  /* APRS sample clock, see APRS_TICK_* in aprs.h */
+  __HAL_TIM_SET_PRESCALER(&htim15, APRS_TICK_PRESCALER);
+  __HAL_TIM_SET_AUTORELOAD(&htim15, APRS_TICK_PERIOD);
 
   /* USER CODE END TIM15_Init 2 */
 
@@ -230,6 +237,27 @@ void HAL_TIM_Base_MspInit(TIM_HandleTypeDef* tim_baseHandle)
     HAL_NVIC_EnableIRQ(TIM1_BRK_TIM15_IRQn);
   /* USER CODE BEGIN TIM15_MspInit 1 */
 
+    /* TIM15 DMA Init */
+    /* TIM15_UP Init */
+    hdma_tim15_up.Instance = DMA1_Channel5;
+    hdma_tim15_up.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_tim15_up.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_tim15_up.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_tim15_up.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    hdma_tim15_up.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    hdma_tim15_up.Init.Mode = DMA_CIRCULAR;
+    hdma_tim15_up.Init.Priority = DMA_PRIORITY_VERY_HIGH;
+    if (HAL_DMA_Init(&hdma_tim15_up) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(tim_baseHandle,hdma[TIM_DMA_ID_UPDATE],hdma_tim15_up);
+
+    /* DMA1_Channel5_IRQn interrupt configuration */
+    HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+
   /* USER CODE END TIM15_MspInit 1 */
   }
   else if(tim_baseHandle->Instance==TIM17)
@@ -288,6 +316,10 @@ void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef* tim_baseHandle)
     HAL_NVIC_DisableIRQ(TIM1_BRK_TIM15_IRQn);
   /* USER CODE BEGIN TIM15_MspDeInit 1 */
 
+    /* TIM15 DMA DeInit */
+    HAL_DMA_DeInit(tim_baseHandle->hdma[TIM_DMA_ID_UPDATE]);
+    HAL_NVIC_DisableIRQ(DMA1_Channel5_IRQn);
+
   /* USER CODE END TIM15_MspDeInit 1 */
   }
   else if(tim_baseHandle->Instance==TIM17)
@@ -305,6 +337,22 @@ void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef* tim_baseHandle)
 
 /* USER CODE BEGIN 1 */
 
+/*
+ * startCycleCounter
+ *
+ * enables the DWT cycle counter of the core and clears it. used to time
+ * code sections in SYSCLK cycles, see getCycleCount.
+ */
+void startCycleCounter(void) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t getCycleCount(void) {
+	return DWT->CYCCNT;
+}
+
 void delay_us(uint16_t us) {
 	__HAL_TIM_SET_COUNTER(&htim17, 0);  // set the counter value a 0
 	while (__HAL_TIM_GET_COUNTER(&htim17) < us);  // wait for the counter to reach the us input in the parameter
@@ -318,34 +366,35 @@ void stopAprsTickTimer(void) {
 	HAL_TIM_Base_Stop_IT(&htim15);
 }
 
+/*
+ * processAprsTick
+ *
+ * advances the tone and bit clock NCOs by one sample.
+ * aprs_tick is raised on every edge of the tone (MSB change of the tone phase),
+ * aprs_baud_tick on every overflow of the baud phase. the tone phase is never
+ * reset, so switching between mark and space is phase continuous.
+ */
 void processAprsTick(void) {
-	static uint16_t aprs_nco_count = 0;
-	static uint16_t aprs_bit_count = 0;
-	aprs_nco_count++;
-	aprs_bit_count++;
-
-	// TESTING
-	//if (aprs_nco_count >= APRS_MARK_TICKS) {
-		//aprs_nco_count = 0;
-		//toggleSiGPIO3();
-	//}
-
-	if (aprs_bit == APRS_SPACE && aprs_nco_count >= APRS_SPACE_TICKS) {
+	static uint32_t aprs_phase = 0;
+	static uint32_t aprs_baud_phase = 0;
+	uint32_t prev;
+
+#ifdef APRS_USE_SINE
+	afsk_sine_tick();
+	return;
+#endif
+
+	prev = aprs_phase;
+	aprs_phase += (aprs_bit == APRS_SPACE) ? APRS_SPACE_STEP : APRS_MARK_STEP;
+	if ((aprs_phase ^ prev) & APRS_NCO_MSB) {
 		aprs_tick = 1;
-		aprs_nco_count = 0;
 	}
-	if (aprs_bit == APRS_MARK && aprs_nco_count >= APRS_MARK_TICKS) {
-		aprs_tick = 1;
-		aprs_nco_count = 0;
-	}
-	if (aprs_bit_count == APRS_BAUD_TICKS) {
+
+	prev = aprs_baud_phase;
+	aprs_baud_phase += APRS_BAUD_STEP;
+	if (aprs_baud_phase < prev) {
 		aprs_baud_tick = 1;
-		aprs_bit_count = 0;
-		//toggleSiGPIO3();
 	}
-
-
-
 }
 
 void resetGpsLockTimer(void) {
@@ -0,0 +1,89 @@
+/**
+  ******************************************************************************
+  * @file    aprs_stubs.c
+  * @brief   Host stand-ins for the hardware used by aprs.c
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  * aprs.c is linked unchanged. The radio, timer, LED and GPIO functions do
+  * nothing, the GNSS snapshot comes from test_fix and the PPS lock is set.
+  ******************************************************************************
+  */
+
+#include "aprs.h"
+#include "si4063.h"
+#include "tim.h"
+#include "led.h"
+#include "gpio.h"
+
+volatile uint16_t aprs_bit;
+volatile uint16_t aprs_tick;
+volatile uint16_t aprs_baud_tick;
+volatile uint8_t ppsLockStatus = 1;
+uint32_t SystemCoreClock = 16000000;
+
+/* the fix every GNSS_GetFix returns */
+GNSS_Fix test_fix;
+
+void GNSS_GetFix(GNSS_StateHandle *GNSS, GNSS_Fix *fix) {
+	*fix = test_fix;
+}
+
+void HAL_Delay(uint32_t Delay) {
+}
+
+uint32_t getCycleCount(void) {
+	return 0;
+}
+
+void startAprsTickTimer(void) {
+}
+
+void stopAprsTickTimer(void) {
+}
+
+void ledOnGreen(void) {
+}
+
+void ledOffGreen(void) {
+}
+
+void toggleSiGPIO3(void) {
+}
+
+void deassertSiGPIO3(void) {
+}
+
+uint8_t si4060_set_power(uint8_t state) {
+	return SI_OK;
+}
+
+void si4060_setup(uint8_t mod_type) {
+}
+
+void si4060_start_tx(uint8_t channel) {
+}
+
+void si4060_stop_tx(void) {
+}
+
+uint8_t si4060_wait_state(uint8_t state, uint32_t timeout_us) {
+	return SI_OK;
+}
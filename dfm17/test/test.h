@@ -0,0 +1,53 @@
+/**
+  ******************************************************************************
+  * @file    test.h
+  * @brief   Minimal check macros for the host tests
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  * Every test is a plain host program: CHECK reports a failed condition with
+  * its location and carries on, TEST_DONE prints the summary and returns the
+  * exit code for make.
+  ******************************************************************************
+  */
+
+#ifndef TEST_TEST_H_
+#define TEST_TEST_H_
+
+#include <stdio.h>
+
+static int test_checks;
+static int test_failures;
+
+#define CHECK(cond, ...) do { \
+		test_checks++; \
+		if (!(cond)) { \
+			test_failures++; \
+			printf("%s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	} while (0)
+
+#define TEST_DONE(name) ( \
+		printf("%s: %d checks, %d failed\n", (name), test_checks, test_failures), \
+		test_failures != 0)
+
+#endif /* TEST_TEST_H_ */
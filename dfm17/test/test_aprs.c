@@ -0,0 +1,516 @@
+/**
+  ******************************************************************************
+  * @file    test_aprs.c
+  * @brief   Host test of the APRS frame encoder
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  * Builds frames from test fixes with aprs.c and compares the pre-encoded
+  * aprs_stream with a straightforward reference encoder: flags, header, info
+  * field and bit-serial FCS, bit stuffed and NRZI coded one bit at a time like
+  * the transmit loop did before the stream was pre-encoded. Every stream is
+  * decoded again with ax25_decode, also corrupted, truncated and into a short
+  * buffer, and a Mic-E frame with its own destination address is checked the
+  * same way. Bursts of queued compressed and Mic-E frames are compared with
+  * the reference encoder as well. The integer position and altitude
+  * compression is checked for every input, latitude and longitude against the
+  * exact formulas, altitude against the float formula, and timed against the
+  * float code it replaced. Last, encoder and decoder throughput is reported
+  * in frames per second on the host.
+  ******************************************************************************
+  */
+
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include "aprs.h"
+#include "fcs.h"
+#include "ax25_decode.h"
+#include "test.h"
+
+extern GNSS_Fix test_fix;
+extern char aprs_buf[];
+extern unsigned char aprs_header[];
+extern uint8_t aprs_header_len;
+extern uint8_t aprs_stream[];
+extern uint16_t aprs_stream_bits;
+
+static GNSS_StateHandle gnss;
+
+static uint32_t rand32(void) {
+	return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+/*
+ * reference encoder
+ */
+static uint8_t ref_stream[APRS_STREAM_LEN];
+static uint16_t ref_bits;
+static uint16_t ref_stuffed;
+static uint8_t ref_level;
+static uint8_t ref_ones;
+
+static void ref_bit(uint8_t bit) {
+	/* NRZI: a zero is a transition */
+	if (!bit) {
+		ref_level ^= 1;
+	}
+	if (ref_level) {
+		ref_stream[ref_bits >> 3] |= 1 << (ref_bits & 0x07);
+	} else {
+		ref_stream[ref_bits >> 3] &= ~(1 << (ref_bits & 0x07));
+	}
+	ref_bits++;
+}
+
+static void ref_byte(uint8_t byte, uint8_t stuff) {
+	uint8_t i, bit;
+
+	for (i = 0; i < 8; i++) {
+		bit = (byte >> i) & 0x01;
+		ref_bit(bit);
+		if (!bit) {
+			ref_ones = 0;
+		} else if (stuff && ++ref_ones == 5) {
+			ref_bit(0);
+			ref_stuffed++;
+			ref_ones = 0;
+		}
+	}
+}
+
+static uint16_t ref_fcs(uint16_t crc, const uint8_t *data, uint16_t len) {
+	uint8_t i;
+
+	while (len--) {
+		for (i = 0; i < 8; i++) {
+			if ((crc & 0x0001) != ((*data >> i) & 0x01)) {
+				crc = (crc >> 1) ^ 0x8408;
+			} else {
+				crc = crc >> 1;
+			}
+		}
+		data++;
+	}
+	return crc;
+}
+
+/* frames: address field, control, PID and info field, without FCS,
+ * sent back to back with AX25_IFLAGS flags in between */
+static void ref_encode_burst(uint8_t frames[][APRS_FRAME_LEN], const uint16_t *lens, uint8_t count) {
+	uint16_t i, crc;
+	uint8_t f;
+
+	ref_bits = 0;
+	ref_stuffed = 0;
+	ref_ones = 0;
+	/* the level before the stream is free, take it from the first flag */
+	ref_level = !(aprs_stream[0] & 0x01);
+
+	for (i = 0; i < AX25_SFLAGS; i++) {
+		ref_byte(AX25_FLAG, 0);
+	}
+	for (f = 0; f < count; f++) {
+		if (f) {
+			for (i = 0; i < AX25_IFLAGS; i++) {
+				ref_byte(AX25_FLAG, 0);
+			}
+		}
+		crc = ref_fcs(0xFFFF, frames[f], lens[f]) ^ 0xFFFF;
+		for (i = 0; i < lens[f]; i++) {
+			ref_byte(frames[f][i], 1);
+		}
+		ref_byte(crc, 1);
+		ref_byte(crc >> 8, 1);
+	}
+	for (i = 0; i < AX25_EFLAGS; i++) {
+		ref_byte(AX25_FLAG, 0);
+	}
+}
+
+static void ref_encode(uint8_t *frame, uint16_t len) {
+	ref_encode_burst((uint8_t (*)[APRS_FRAME_LEN])frame, &len, 1);
+}
+
+/* aprs_header + aprs_buf */
+static uint16_t buf_frame(uint8_t *frame) {
+	uint16_t i, len = 0;
+
+	for (i = 0; i < aprs_header_len; i++) {
+		frame[len++] = aprs_header[i];
+	}
+	for (i = 0; i < APRS_BUF_LEN; i++) {
+		frame[len++] = aprs_buf[i];
+	}
+	return len;
+}
+
+/* compares aprs_stream with the reference, the stream may end inside a closing flag */
+static void check_stream(const char *what) {
+	uint16_t n;
+
+	CHECK(aprs_stream_bits >= ref_bits && aprs_stream_bits - ref_bits < 8,
+			"%s: %u bits, reference %u", what, aprs_stream_bits, ref_bits);
+	for (n = 0; n < ref_bits && n < aprs_stream_bits; n++) {
+		if (((aprs_stream[n >> 3] ^ ref_stream[n >> 3]) >> (n & 0x07)) & 0x01) {
+			CHECK(0, "%s: bit %u differs", what, n);
+			break;
+		}
+	}
+}
+
+/* decodes aprs_stream and compares with the frame encoded */
+static void check_decode(const char *what, const uint8_t *frame, uint16_t len) {
+	static uint8_t stream[APRS_STREAM_LEN];
+	uint8_t out[APRS_FRAME_LEN];
+	uint16_t i, n;
+	int16_t res;
+
+	res = ax25_decode(aprs_stream, aprs_stream_bits, out, sizeof(out));
+	CHECK(res == len, "%s: decoded %d bytes, encoded %u", what, res, len);
+	for (i = 0; res == len && i < len; i++) {
+		if (out[i] != frame[i]) {
+			CHECK(0, "%s: byte %u decoded %02X, encoded %02X", what, i, out[i], frame[i]);
+			break;
+		}
+	}
+
+	res = ax25_decode(aprs_stream, aprs_stream_bits, out, len);
+	CHECK(res == AX25_ERR_OVERFLOW, "%s: short buffer %d", what, res);
+	res = ax25_decode(aprs_stream, aprs_stream_bits - 16, out, sizeof(out));
+	CHECK(res == AX25_ERR_NOFRAME, "%s: truncated %d", what, res);
+
+	/* one flipped level inside the frame changes two bits, never unnoticed */
+	for (i = 0; i < sizeof(stream); i++) {
+		stream[i] = aprs_stream[i];
+	}
+	n = 8 * (AX25_SFLAGS + 1) + rand() % (8 * len);
+	stream[n >> 3] ^= 1 << (n & 0x07);
+	res = ax25_decode(stream, aprs_stream_bits, out, sizeof(out));
+	CHECK(res < 0, "%s: bit %u flipped, decoded %d bytes", what, n, res);
+}
+
+static void test_bitstream(void) {
+	static const char * const path[] = {"WIDE1", "WIDE2"};
+	static const uint8_t path_ssid[] = {1, 2};
+	uint8_t frame[APRS_FRAME_LEN];
+	uint32_t stuffed = 0;
+	uint16_t i, len;
+
+	srand(2);
+	for (i = 0; i < 200; i++) {
+		test_fix.lat = (int32_t)(rand32() % 1800000001UL) - 900000000L;
+		test_fix.lon = (int32_t)(rand32() % 3600000001UL - 1800000000UL);
+		test_fix.hMSL = rand32() % 50000000UL;
+		aprs_prepare_buffer(&gnss, i & 1);
+		len = buf_frame(frame);
+		ref_encode(frame, len);
+		check_stream("compressed");
+		check_decode("compressed", frame, len);
+		stuffed += ref_stuffed;
+	}
+	/* the frames have to exercise the bit stuffing */
+	CHECK(stuffed > 0, "no stuffed bits in %u frames", i);
+
+	CHECK(aprs_set_header("APZ123", 0, "N0CALL", 15, path, path_ssid, 2) == 0, "header");
+	aprs_encode_frame();
+	len = buf_frame(frame);
+	ref_encode(frame, len);
+	check_stream("two hop path");
+	check_decode("two hop path", frame, len);
+}
+
+/* Mic-E frames carry their own destination, the rest of the header is shared */
+static uint16_t mice_frame(uint8_t *frame, const char *dst, const char *info) {
+	uint16_t i, len = 0;
+
+	for (i = 0; i < MICE_DST_LEN; i++) {
+		frame[len++] = dst[i] << 1;
+	}
+	frame[len++] = aprs_header[MICE_DST_LEN];
+	for (i = APRS_ADDR_LEN; i < aprs_header_len; i++) {
+		frame[len++] = aprs_header[i];
+	}
+	for (i = 0; i < MICE_INFO_LEN; i++) {
+		frame[len++] = info[i];
+	}
+	return len;
+}
+
+static void test_mice_frame(void) {
+	uint8_t frame[APRS_FRAME_LEN];
+	char dst[MICE_DST_LEN + 1], info[MICE_INFO_LEN];
+	uint16_t len;
+
+	test_fix.lat = 334273334;
+	test_fix.lon = -1121290000;
+	test_fix.hMSL = 1234000;
+	CHECK(aprs_prepare_mice(&gnss) == 0, "Mic-E not prepared");
+	mice_encode(&test_fix, dst, info);
+	len = mice_frame(frame, dst, info);
+	ref_encode(frame, len);
+	check_stream("Mic-E");
+	check_decode("Mic-E", frame, len);
+
+	/* the next compressed frame goes back to the shared destination */
+	aprs_prepare_buffer(&gnss, 0);
+	len = buf_frame(frame);
+	ref_encode(frame, len);
+	check_stream("compressed after Mic-E");
+}
+
+/*
+ * frames queued for a burst keep their info field and Mic-E destination,
+ * the header is taken when the burst is encoded
+ */
+static struct {
+	uint8_t mice;
+	char dst[MICE_DST_LEN + 1];
+	char info[APRS_FRAME_LEN];
+} queued[APRS_QUEUE_LEN];
+
+static void queue_frame(uint8_t n, uint8_t mice) {
+	uint16_t i;
+
+	test_fix.lat = (int32_t)(rand32() % 1800000001UL) - 900000000L;
+	test_fix.lon = (int32_t)(rand32() % 3600000001UL - 1800000000UL);
+	test_fix.hMSL = rand32() % 50000000UL;
+	queued[n].mice = mice;
+	if (mice) {
+		CHECK(aprs_prepare_mice(&gnss) == 0, "Mic-E frame %u not prepared", n);
+		mice_encode(&test_fix, queued[n].dst, queued[n].info);
+	} else {
+		aprs_prepare_buffer(&gnss, 0);
+		for (i = 0; i < APRS_BUF_LEN; i++) {
+			queued[n].info[i] = aprs_buf[i];
+		}
+	}
+	CHECK(aprs_queue_frame() == 0, "frame %u not queued", n);
+}
+
+static void check_burst(const char *what, uint8_t count) {
+	static uint8_t frames[APRS_QUEUE_LEN][APRS_FRAME_LEN];
+	uint16_t lens[APRS_QUEUE_LEN], i;
+	uint8_t n;
+
+	CHECK(aprs_queue_count() == count, "%s: %u queued", what, aprs_queue_count());
+	CHECK(aprs_encode_burst() == count, "%s: burst of %u", what, count);
+	CHECK(aprs_queue_count() == 0, "%s: queue not emptied", what);
+	for (n = 0; n < count; n++) {
+		if (queued[n].mice) {
+			lens[n] = mice_frame(frames[n], queued[n].dst, queued[n].info);
+		} else {
+			lens[n] = 0;
+			for (i = 0; i < aprs_header_len; i++) {
+				frames[n][lens[n]++] = aprs_header[i];
+			}
+			for (i = 0; i < APRS_BUF_LEN; i++) {
+				frames[n][lens[n]++] = queued[n].info[i];
+			}
+		}
+	}
+	ref_encode_burst(frames, lens, count);
+	check_stream(what);
+	CHECK(aprs_stream_bits < APRS_STREAM_BITS, "%s: stream cut at %u bits", what, aprs_stream_bits);
+}
+
+static void test_burst(void) {
+	static const char * const path[] = {"WIDE2"};
+	static const uint8_t path_ssid[] = {1};
+	uint16_t i;
+	uint8_t count, n;
+
+	srand(8);
+	CHECK(aprs_encode_burst() == 0, "empty burst");
+	for (i = 0; i < 50; i++) {
+		count = 2 + i % (APRS_QUEUE_LEN - 1);
+		for (n = 0; n < count; n++) {
+			queue_frame(n, (n + i) & 1);
+		}
+		check_burst("burst", count);
+	}
+
+	/* the queue takes APRS_QUEUE_LEN frames, no more */
+	for (n = 0; n < APRS_QUEUE_LEN; n++) {
+		queue_frame(n, n == 1);
+	}
+	CHECK(aprs_queue_frame() == 1, "queue not full at %u frames", APRS_QUEUE_LEN);
+	CHECK(aprs_queue_count() == APRS_QUEUE_LEN, "%u queued", aprs_queue_count());
+	check_burst("full queue", APRS_QUEUE_LEN);
+
+	/* a header changed after queueing is used, with the FCS of every frame recomputed */
+	queue_frame(0, 0);
+	queue_frame(1, 1);
+	CHECK(aprs_set_header("APZ124", 0, "N0CALL", 11, path, path_ssid, 1) == 0, "header");
+	check_burst("new header", 2);
+}
+
+#define BENCH_FRAMES	20000
+#define BENCH_CALLS		1000000
+
+/* keeps the timed results from being optimized away */
+volatile uint32_t bench_sink;
+
+static double seconds(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the float formulas the integer compression replaced */
+static uint32_t float_lat(int32_t lat) {
+	return 380926.0f * (90.0f - lat / 1e7f);
+}
+
+static uint32_t float_lon(int32_t lon) {
+	return 190463.0f * (180.0f + lon / 1e7f);
+}
+
+static uint32_t float_alt(int32_t hmsl) {
+	return logf(hmsl * 3.28f / 1000.0f) / logf(1.002f);
+}
+
+static uint32_t int_alt(int32_t hmsl) {
+	return aprs_compress_alt(hmsl);
+}
+
+/* host ns per call over inputs spread across the range */
+static double bench_call(uint32_t (*fn)(int32_t), int32_t lo, uint32_t span) {
+	double start;
+	uint32_t i, sum = 0;
+
+	start = seconds();
+	for (i = 0; i < BENCH_CALLS; i++) {
+		sum += fn(lo + (int32_t)((uint64_t)i * span / BENCH_CALLS));
+	}
+	bench_sink = sum;
+	return (seconds() - start) * 1e9 / BENCH_CALLS;
+}
+
+static void test_compress_cycles(void) {
+	printf("aprs compress, ns per call: lat %.1f (float %.1f), lon %.1f (float %.1f),"
+			" alt %.1f (float %.1f)\n",
+			bench_call(aprs_compress_lat, -900000000L, 1800000000UL),
+			bench_call(float_lat, -900000000L, 1800000000UL),
+			bench_call(aprs_compress_lon, -1800000000L, 3600000000UL),
+			bench_call(float_lon, -1800000000L, 3600000000UL),
+			bench_call(int_alt, 1000, APRS_ALT_MAX_MM),
+			bench_call(float_alt, 1000, APRS_ALT_MAX_MM));
+}
+
+/* host throughput of the encoder (FCS and bitstream) and of the decoder */
+static void test_throughput(void) {
+	uint8_t out[APRS_FRAME_LEN];
+	uint32_t i, ok = 0;
+	double start, encode, decode;
+
+	test_fix.lat = 334273334;
+	test_fix.lon = -1121290000;
+	test_fix.hMSL = 1234000;
+	aprs_prepare_buffer(&gnss, 0);
+
+	start = seconds();
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		aprs_encode_frame();
+	}
+	encode = seconds() - start;
+
+	start = seconds();
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		ok += ax25_decode(aprs_stream, aprs_stream_bits, out, sizeof(out)) > 0;
+	}
+	decode = seconds() - start;
+	CHECK(ok == BENCH_FRAMES, "%lu of %u frames decoded", (unsigned long)ok, BENCH_FRAMES);
+
+	printf("aprs: %u bit frame, %.0f frames/s encoded, %.0f frames/s decoded\n",
+			aprs_stream_bits, BENCH_FRAMES / encode, BENCH_FRAMES / decode);
+}
+
+static void check_compress(const char *what, int32_t in, uint32_t out, double ref) {
+	double err = (double)out - floor(ref);
+
+	CHECK(fabs(err) <= 1.0, "%s(%ld) = %lu, float %.3f", what, (long)in, (unsigned long)out, ref);
+}
+
+/*
+ * every input from lo to hi against the exact floor(scale * (deg - min deg)),
+ * counting from the end the formula is 0 at. dir is -1 for latitude, which
+ * counts from the north pole
+ */
+static void scan_latlon(const char *what, uint32_t (*fn)(int32_t),
+		int32_t lo, int32_t hi, uint32_t scale, int8_t dir) {
+	uint64_t bad = 0, points = 0;
+	int64_t v, from = (dir > 0) ? lo : hi;
+	uint32_t out, ref;
+
+	for (v = from; v >= lo && v <= hi; v += dir) {
+		ref = (uint64_t)scale * (uint64_t)((v - from) * dir) / 10000000u;
+		out = fn(v);
+		if (out - ref + 1 > 2) {
+			if (!bad) {
+				CHECK(0, "%s(%ld) = %lu, exact %lu", what, (long)v, (unsigned long)out,
+						(unsigned long)ref);
+			}
+			bad++;
+		}
+		points++;
+	}
+	CHECK(bad == 0, "%s: %llu of %llu inputs off by more than 1", what,
+			(unsigned long long)bad, (unsigned long long)points);
+}
+
+static void test_compress(void) {
+	int64_t v;
+	double ft;
+
+	scan_latlon("lat", aprs_compress_lat, -900000000L, 900000000L, 380926, -1);
+	check_compress("lat", 900000000L, aprs_compress_lat(900000000L), 0.0);
+	check_compress("lat", -900000000L, aprs_compress_lat(-900000000L), 380926.0 * 180.0);
+	CHECK(aprs_compress_lat(INT32_MAX) == aprs_compress_lat(900000000L), "lat clamp north");
+	CHECK(aprs_compress_lat(INT32_MIN) == aprs_compress_lat(-900000000L), "lat clamp south");
+
+	scan_latlon("lon", aprs_compress_lon, -1800000000L, 1800000000L, 190463, 1);
+	check_compress("lon", -1800000000L, aprs_compress_lon(-1800000000L), 0.0);
+	check_compress("lon", 1800000000L, aprs_compress_lon(1800000000L), 190463.0 * 360.0);
+	CHECK(aprs_compress_lon(INT32_MAX) == aprs_compress_lon(1800000000L), "lon clamp east");
+	CHECK(aprs_compress_lon(INT32_MIN) == aprs_compress_lon(-1800000000L), "lon clamp west");
+
+	/* log(ft) / log(1.002), 0 below 1 ft */
+	for (v = 1; v <= APRS_ALT_MAX_MM; v++) {
+		ft = v / 1000.0 * 3.28;
+		check_compress("alt", v, aprs_compress_alt(v), ft < 1.0 ? 0.0 : log(ft) / log(1.002));
+	}
+	CHECK(aprs_compress_alt(0) == 0, "alt at 0 mm");
+	CHECK(aprs_compress_alt(-1000) == 0, "alt below sea level");
+	CHECK(aprs_compress_alt(INT32_MAX) == aprs_compress_alt(APRS_ALT_MAX_MM), "alt clamp");
+	/* the top altitude still fits two base91 digits */
+	CHECK(aprs_compress_alt(APRS_ALT_MAX_MM) < 91 * 91, "alt range %u", aprs_compress_alt(APRS_ALT_MAX_MM));
+}
+
+int main(void) {
+	test_bitstream();
+	test_mice_frame();
+	test_burst();
+	test_compress();
+	test_compress_cycles();
+	test_throughput();
+	return TEST_DONE("aprs");
+}
@@ -0,0 +1,474 @@
+/**
+  ******************************************************************************
+  * @file    test_gnss.c
+  * @brief   Host test of the GNSS fix snapshot
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  * GNSS.c is included with the Cortex-M intrinsics mapped to the host: __DMB
+  * becomes a full barrier, PRIMASK is a no-op. A timer signal stands in for the
+  * UART interrupt: it preempts the main loop at arbitrary points, also in the
+  * middle of GNSS_GetFix, and feeds one NAV-PVT frame through the receive ring
+  * and the UBX parser.
+  * Every field of a published fix is derived from one counter, a torn copy
+  * shows up as fields that disagree. The request queue is driven through ACK,
+  * NAK, answers, time outs on a stubbed HAL_GetTick, late answers and a full
+  * queue with GNSS_Tick retrying. GNSS_LoadConfig runs against a model of the
+  * receiver that only understands frames at its own rate, with and without
+  * following the CFG-PRT to GNSS_BAUD_FAST.
+  ******************************************************************************
+  */
+
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include "stm32f1xx_hal.h"
+
+#undef __DMB
+#define __DMB()				__sync_synchronize()
+#define __disable_irq()		do { } while (0)
+#define __get_PRIMASK()		0
+#define __set_PRIMASK(x)	((void)(x))
+
+#include "../Core/Src/GNSS.c"
+#include "test.h"
+
+#define FIXES	100000
+
+uint32_t SystemCoreClock = 16000000;
+
+GNSS_StateHandle GNSS_Handle;
+static UART_HandleTypeDef huart;
+static uint16_t head;
+static volatile sig_atomic_t fixes;
+
+/* SysTick, advanced by the tests */
+static uint32_t tick;
+
+/* frames handed to the UART, class and ID */
+static uint16_t tx_log[32];
+static uint8_t tx_count;
+
+/* rates USART2 was set up with */
+static uint32_t init_log[4];
+static uint8_t init_count;
+
+/* the receiver, answering at its rate what it understood */
+static struct {
+	uint8_t on;
+	uint32_t rate;
+	uint8_t follow;		/* takes the rate of a CFG-PRT */
+	uint8_t portAck;	/* acknowledges a CFG-PRT at the old rate */
+	uint8_t answer[100];
+	uint16_t answerLen;
+	uint32_t answerRate;
+	uint32_t answerDue;
+} rx;
+
+static void ack_frame(uint8_t *frame, uint16_t msg, uint8_t ok);
+static uint16_t pvt_frame(uint8_t *frame, int32_t k);
+
+/* ms for a frame on the wire, 10 bits a byte */
+static uint32_t airtime(uint16_t len, uint32_t rate) {
+	return len * 10UL * 1000 / rate + 1;
+}
+
+static void receiver(const uint8_t *frame) {
+	uint16_t msg = (frame[2] << 8) | frame[3];
+	uint32_t rate = rx.rate;
+
+	if (huart.Init.BaudRate != rx.rate) {
+		return;
+	}
+	if (frame[2] == 0x06) {
+		rx.answerLen = 10;
+		ack_frame(rx.answer, msg, 1);
+		if (frame[3] == 0x00) {
+			if (!rx.portAck) {
+				rx.answerLen = 0;
+			}
+			if (rx.follow) {
+				rx.rate = frame[14] | (frame[15] << 8) | ((uint32_t)frame[16] << 16);
+			}
+		}
+	} else if (msg == 0x0107) {
+		rx.answerLen = pvt_frame(rx.answer, 1);
+	}
+	rx.answerRate = rate;
+	rx.answerDue = tick + airtime(rx.answerLen, rate);
+}
+
+uint32_t HAL_GetTick(void) {
+	return tick;
+}
+
+uint32_t getCycleCount(void) {
+	return tick * (SystemCoreClock / 1000);
+}
+
+/* the DMA starts over at the beginning of the ring */
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size) {
+	head = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size) {
+	if (tx_count < sizeof(tx_log) / sizeof(tx_log[0])) {
+		tx_log[tx_count] = (pData[2] << 8) | pData[3];
+	}
+	tx_count++;
+	if (rx.on) {
+		receiver(pData);
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart) {
+	if (init_count < sizeof(init_log) / sizeof(init_log[0])) {
+		init_log[init_count] = huart->Init.BaudRate;
+	}
+	init_count++;
+	return HAL_OK;
+}
+
+static void put32(uint8_t *buf, int32_t val) {
+	buf[0] = val;
+	buf[1] = val >> 8;
+	buf[2] = val >> 16;
+	buf[3] = val >> 24;
+}
+
+/* copies a frame into the ring like the DMA, in pieces the ring can hold */
+static void feed(const uint8_t *frame, uint16_t len) {
+	uint16_t i;
+
+	for (i = 0; i < len; i++) {
+		GNSS_Handle.rxRing[head] = frame[i];
+		head = (head + 1) % GNSS_RX_RING;
+		if ((i & 0x1f) == 0x1f || i == len - 1) {
+			GNSS_ParseBuffer(&GNSS_Handle, head);
+		}
+	}
+}
+
+/* NAV-PVT with every field derived from k */
+static uint16_t pvt_frame(uint8_t *frame, int32_t k) {
+	uint8_t payload[4 + 92];
+	uint8_t i;
+
+	for (i = 0; i < sizeof(payload); i++) {
+		payload[i] = 0;
+	}
+	payload[0] = 0x01;
+	payload[1] = 0x07;
+	payload[2] = 92;
+	payload[4 + PVT_YEAR] = k;
+	payload[4 + PVT_YEAR + 1] = k >> 8;
+	payload[4 + PVT_SEC] = k % 60;
+	payload[4 + PVT_NUMSV] = k;
+	put32(&payload[4 + PVT_LON], -k);
+	put32(&payload[4 + PVT_LAT], k);
+	put32(&payload[4 + PVT_HMSL], 3 * k);
+	put32(&payload[4 + PVT_GSPEED], k ^ 0x5a5a5a5a);
+	put32(&payload[4 + PVT_HEADMOT], ~k);
+	buildUbxPacket(frame, payload, sizeof(payload));
+	return sizeof(payload) + 4;
+}
+
+/* the "UART interrupt" */
+static void writer(int sig) {
+	uint8_t frame[100];
+
+	if (fixes < FIXES) {
+		fixes++;
+		feed(frame, pvt_frame(frame, fixes));
+	}
+}
+
+static void check_fix(const GNSS_Fix *fix, int32_t k) {
+	CHECK(fix->lon == -k && fix->hMSL == 3 * k && fix->gSpeed == (k ^ 0x5a5a5a5a)
+			&& fix->headMot == ~k && fix->year == (uint16_t)k && fix->sec == k % 60
+			&& fix->numSV == (uint8_t)k,
+			"torn fix: lat %ld lon %ld hMSL %ld", (long)k, (long)fix->lon, (long)fix->hMSL);
+}
+
+/* ACK-ACK or ACK-NAK of a message */
+static void ack_frame(uint8_t *frame, uint16_t msg, uint8_t ok) {
+	uint8_t payload[6] = { 0x05, ok, 0x02, 0x00, msg >> 8, msg };
+
+	buildUbxPacket(frame, payload, sizeof(payload));
+}
+
+static void ack(uint16_t msg, uint8_t ok) {
+	uint8_t frame[10];
+
+	ack_frame(frame, msg, ok);
+	feed(frame, sizeof(frame));
+}
+
+static uint8_t done_status[16];
+static uint8_t done_count;
+
+static void done(GNSS_StateHandle *GNSS, uint8_t status) {
+	if (done_count < sizeof(done_status)) {
+		done_status[done_count] = status;
+	}
+	done_count++;
+}
+
+/* retried from GNSS_Tick while the queue is full */
+static uint8_t retried;
+
+static void submit_retry(GNSS_StateHandle *GNSS) {
+	retried++;
+	if (GNSS_Submit(GNSS, setPVTOff, sizeof(setPVTOff), done) != GNSS_OK) {
+		GNSS->retry = submit_retry;
+	}
+}
+
+static void test_requests(void) {
+	GNSS_StateHandle *G = &GNSS_Handle;
+	uint8_t frame[100], i;
+	GNSS_Fix fix;
+
+	GNSS_Init(G, &huart);
+	tick = 1000;
+	tx_count = 0;
+	done_count = 0;
+
+	/* CFG acknowledged, CFG refused, poll answered by its data */
+	CHECK(GNSS_Submit(G, setNMEA410, sizeof(setNMEA410), done) == GNSS_OK, "submit");
+	CHECK(GNSS_Submit(G, setPVTOff, sizeof(setPVTOff), done) == GNSS_OK, "submit");
+	CHECK(GNSS_GetPVTData(G, done) == GNSS_OK, "submit");
+	CHECK(tx_count == 1 && tx_log[0] == 0x0617, "%u frames sent, first %04X", tx_count, tx_log[0]);
+	ack(0x0617, 1);
+	CHECK(done_count == 1 && done_status[0] == GNSS_OK, "ACK: %u done, %u", done_count, done_status[0]);
+	CHECK(tx_count == 2 && tx_log[1] == 0x0601, "next after ACK: %04X", tx_log[1]);
+	ack(0x0601, 0);
+	CHECK(done_count == 2 && done_status[1] == GNSS_ERR_NAK, "NAK: %u", done_status[1]);
+	CHECK(tx_count == 3 && tx_log[2] == 0x0107, "next after NAK: %04X", tx_log[2]);
+	feed(frame, pvt_frame(frame, 99));
+	CHECK(done_count == 3 && done_status[2] == GNSS_OK, "poll: %u", done_status[2]);
+	GNSS_GetFix(G, &fix);
+	CHECK(fix.lat == 99, "polled fix %ld", (long)fix.lat);
+	CHECK(G->qCount == 0 && G->rxExpect == 0, "queue not empty");
+
+	/* time out after GNSS_TIMEOUT_MS, not before */
+	GNSS_Submit(G, setNMEA410, sizeof(setNMEA410), done);
+	GNSS_Submit(G, setPVTOff, sizeof(setPVTOff), done);
+	tick += GNSS_TIMEOUT_MS - 1;
+	GNSS_Tick(G);
+	CHECK(done_count == 3, "timed out early");
+	tick++;
+	GNSS_Tick(G);
+	CHECK(done_count == 4 && done_status[3] == GNSS_ERR_TIMEOUT, "timeout: %u", done_status[3]);
+	CHECK(tx_count == 5 && tx_log[4] == 0x0601, "next after timeout: %04X", tx_log[4]);
+
+	/* the late answer to the timed out request completes nothing */
+	ack(0x0617, 1);
+	CHECK(done_count == 4 && G->qCount == 1, "late ACK completed a request");
+	/* the time out seen by the tick before the answer came in is checked again */
+	tick += 10;
+	GNSS_Complete(G, GNSS_ERR_TIMEOUT);
+	CHECK(done_count == 4 && G->qCount == 1, "stale timeout completed a request");
+	ack(0x0601, 1);
+	CHECK(done_count == 5 && done_status[4] == GNSS_OK, "ACK after late ACK: %u", done_status[4]);
+	ack(0x0601, 1);
+	CHECK(done_count == 5, "ACK with an empty queue");
+
+	/* a full queue refuses, the retry from GNSS_Tick gets in once there is room */
+	for (i = 0; i < GNSS_QUEUE_LEN; i++) {
+		CHECK(GNSS_Submit(G, setNMEA410, sizeof(setNMEA410), done) == GNSS_OK, "submit %u", i);
+	}
+	CHECK(GNSS_Submit(G, setNMEA410, sizeof(setNMEA410), done) == GNSS_ERR_BUSY, "queue not full");
+	retried = 0;
+	submit_retry(G);
+	GNSS_Tick(G);
+	CHECK(retried == 2 && G->retry == submit_retry, "retry on a full queue: %u", retried);
+	ack(0x0617, 1);
+	GNSS_Tick(G);
+	CHECK(retried == 3 && G->retry == NULL && G->qCount == GNSS_QUEUE_LEN, "retry: %u, %u queued",
+			retried, G->qCount);
+	for (i = 0; i < GNSS_QUEUE_LEN - 1; i++) {
+		ack(0x0617, 1);
+	}
+	CHECK(tx_log[(tx_count - 1) % 32] == 0x0601, "retried request not sent");
+	ack(0x0601, 1);
+	CHECK(G->qCount == 0 && done_count == 5 + GNSS_QUEUE_LEN + 1, "%u done", done_count);
+}
+
+/* GNSS_LoadConfig against the receiver model, 1 ms a step */
+static void run_config(uint8_t follow, uint8_t portAck) {
+	GNSS_StateHandle *G = &GNSS_Handle;
+	uint8_t frame[100];
+	uint16_t len, n;
+
+	huart.Init.BaudRate = GNSS_BAUD_DEFAULT;
+	GNSS_Init(G, &huart);
+	tick = 1000;
+	tx_count = 0;
+	init_count = 0;
+	rx.on = 1;
+	rx.rate = GNSS_BAUD_DEFAULT;
+	rx.follow = follow;
+	rx.portAck = portAck;
+	rx.answerLen = 0;
+
+	GNSS_LoadConfig(G);
+	for (n = 0; n < 10000 && (G->qCount || G->retry || rx.answerLen); n++) {
+		tick++;
+		if (rx.answerLen && tick >= rx.answerDue) {
+			// a frame sent at another rate is noise to the UART
+			len = rx.answerLen;
+			rx.answerLen = 0;
+			if (rx.answerRate == huart.Init.BaudRate) {
+				memcpy(frame, rx.answer, len);
+				feed(frame, len);
+			}
+		}
+		GNSS_Tick(G);
+	}
+	rx.on = 0;
+	CHECK(G->qCount == 0 && G->retry == NULL, "configuration still running");
+}
+
+static void check_steps(const uint16_t *steps, uint8_t count) {
+	uint8_t i;
+
+	CHECK(tx_count == count, "%u frames sent, %u expected", tx_count, count);
+	for (i = 0; i < count && i < tx_count; i++) {
+		CHECK(tx_log[i] == steps[i], "step %u: %04X, %04X expected", i, tx_log[i], steps[i]);
+	}
+}
+
+static void test_baud(void) {
+	GNSS_StateHandle *G = &GNSS_Handle;
+	// CFG-PRT, CFG-NMEA, CFG-GNSS, CFG-RATE, CFG-MSG off, poll, CFG-PRT fast, poll
+	static const uint16_t fast[] = { 0x0600, 0x0617, 0x063E, 0x0608, 0x0601,
+			0x0107, 0x0600, 0x0107, 0x0601 };
+	// ... the fast poll unanswered, CFG-PRT back, CFG-MSG on
+	static const uint16_t fallback[] = { 0x0600, 0x0617, 0x063E, 0x0608, 0x0601,
+			0x0107, 0x0600, 0x0107, 0x0600, 0x0601 };
+	uint32_t slow = airtime(100, GNSS_BAUD_DEFAULT) * 1000;
+
+	// receiver switches and acknowledges at the old rate
+	run_config(1, 1);
+	check_steps(fast, sizeof(fast) / sizeof(fast[0]));
+	CHECK(init_count == 1 && init_log[0] == GNSS_BAUD_FAST, "%u inits, %lu", init_count,
+			(unsigned long)init_log[0]);
+	CHECK(G->baud == GNSS_BAUD_FAST && huart.Init.BaudRate == GNSS_BAUD_FAST, "baud %lu",
+			(unsigned long)G->baud);
+	CHECK(G->pvtLatencyUs[0] == slow && G->pvtLatencyUs[1] == airtime(100, GNSS_BAUD_FAST) * 1000,
+			"poll %lu us, %lu us", (unsigned long)G->pvtLatencyUs[0], (unsigned long)G->pvtLatencyUs[1]);
+	CHECK(G->pvtPeriodic, "periodic NAV-PVT off");
+
+	// acknowledge lost in the switch, USART2 follows on the time out
+	run_config(1, 0);
+	check_steps(fast, sizeof(fast) / sizeof(fast[0]));
+	CHECK(init_count == 1 && G->baud == GNSS_BAUD_FAST, "baud %lu", (unsigned long)G->baud);
+	CHECK(G->pvtLatencyUs[1] != 0 && G->pvtPeriodic, "no fast poll");
+
+	// CFG-PRT ignored: time out, fast poll times out, back to the default rate
+	run_config(0, 0);
+	check_steps(fallback, sizeof(fallback) / sizeof(fallback[0]));
+	CHECK(init_count == 2 && init_log[0] == GNSS_BAUD_FAST && init_log[1] == GNSS_BAUD_DEFAULT,
+			"%u inits, %lu, %lu", init_count, (unsigned long)init_log[0], (unsigned long)init_log[1]);
+	CHECK(G->baud == GNSS_BAUD_DEFAULT && huart.Init.BaudRate == GNSS_BAUD_DEFAULT, "baud %lu",
+			(unsigned long)G->baud);
+	CHECK(G->pvtLatencyUs[0] == slow && G->pvtLatencyUs[1] == 0, "poll %lu us, %lu us",
+			(unsigned long)G->pvtLatencyUs[0], (unsigned long)G->pvtLatencyUs[1]);
+	CHECK(G->pvtPeriodic, "receiver lost after the fallback");
+}
+
+/* a false sync with a huge length must not swallow the frames behind it */
+static void test_resync(void) {
+	static const uint8_t noise[] = { 0xB5, 0x62, 0x01, 0x07, 0xff, 0xff };
+	uint8_t frame[100], skipped[8 + 200];
+	uint16_t errors = GNSS_Handle.rxErrors;
+	GNSS_Fix fix;
+
+	feed(noise, sizeof(noise));
+	feed(frame, pvt_frame(frame, 4711));
+	GNSS_GetFix(&GNSS_Handle, &fix);
+	CHECK(fix.lat == 4711, "fix after a false sync: %ld", (long)fix.lat);
+	CHECK(GNSS_Handle.rxErrors == errors + 1, "%u errors", GNSS_Handle.rxErrors - errors);
+
+	/* a long frame of another class is skipped, the next one is parsed */
+	memset(skipped, 0x55, sizeof(skipped));
+	skipped[2] = 0x01;
+	skipped[3] = 0x35;
+	skipped[4] = 200;
+	skipped[5] = 0;
+	buildUbxPacket(skipped, &skipped[2], 4 + 200);
+	feed(skipped, sizeof(skipped));
+	feed(frame, pvt_frame(frame, 4712));
+	GNSS_GetFix(&GNSS_Handle, &fix);
+	CHECK(fix.lat == 4712, "fix after a skipped frame: %ld", (long)fix.lat);
+	CHECK(GNSS_Handle.rxErrors == errors + 1, "%u errors", GNSS_Handle.rxErrors - errors);
+}
+
+static void test_seqlock(void) {
+	struct itimerval timer = { { 0, 20 }, { 0, 20 } };
+	GNSS_Fix fix;
+	int32_t last = 0;
+	uint32_t reads = 0, changes = 0;
+
+	fixes = 0;
+	signal(SIGALRM, writer);
+	setitimer(ITIMER_REAL, &timer, NULL);
+	while (fixes < FIXES) {
+		GNSS_GetFix(&GNSS_Handle, &fix);
+		reads++;
+		if (fix.lat == 0) {
+			continue;
+		}
+		check_fix(&fix, fix.lat);
+		CHECK(fix.lat >= last, "fix went back from %ld to %ld", (long)last, (long)fix.lat);
+		if (fix.lat != last) {
+			changes++;
+		}
+		last = fix.lat;
+		if (test_failures > 10) {
+			break;
+		}
+	}
+	timer.it_value.tv_usec = 0;
+	setitimer(ITIMER_REAL, &timer, NULL);
+
+	GNSS_GetFix(&GNSS_Handle, &fix);
+	CHECK(fix.lat == FIXES, "last fix %ld", (long)fix.lat);
+	check_fix(&fix, fix.lat);
+	printf("%lu snapshots, %lu fixes seen\n", (unsigned long)reads, (unsigned long)changes);
+}
+
+int main(void) {
+	huart.Init.BaudRate = 9600;
+	GNSS_Init(&GNSS_Handle, &huart);
+	test_seqlock();
+	CHECK(GNSS_Handle.rxErrors == 0, "%u checksum errors", GNSS_Handle.rxErrors);
+	test_resync();
+	test_requests();
+	test_baud();
+	return TEST_DONE("gnss");
+}
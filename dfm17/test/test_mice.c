@@ -0,0 +1,211 @@
+/**
+  ******************************************************************************
+  * @file    test_mice.c
+  * @brief   Host test of the Mic-E encoder
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  * Checks mice_encode against vectors worked out by hand from the APRS 1.0.1
+  * Mic-E rules (one per longitude degree range), then decodes random fixes
+  * with an independent implementation of those rules and compares position,
+  * speed, course and altitude with the encoded fix. Last, the same fixes are
+  * encoded as compressed and as Mic-E frames with aprs.c to report the bytes
+  * and the airtime Mic-E saves.
+  ******************************************************************************
+  */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aprs.h"
+#include "mice.h"
+#include "test.h"
+
+extern GNSS_Fix test_fix;
+extern uint8_t aprs_header_len;
+extern uint16_t aprs_stream_bits;
+
+typedef struct {
+	int32_t lat, lon, gSpeed, headMot, hMSL;
+	const char *dst;
+	const char info[MICE_INFO_LEN + 1];
+} mice_vector;
+
+static const mice_vector vectors[] = {
+	/* 33 25.64 N 112 07.74 W, standing at sea level */
+	{ 334273334, -1121290000, 0, 0, 0,
+		"S3RUVT", "`(_fl\x1c\x1cO/\"3r}" },
+	/* 4 05.00 S 5 30.00 E, 100 kn, 123 deg, 1234 m */
+	{ -40833334, 55000000, 51445, 12300000, 1234000,
+		"P4P5P0", "`{:\x1cv\x1d" "3O/\"AJ}" },
+	/* equator, 105 30.00 W, 250 kn, 359 deg, below the altitude range */
+	{ 0, -1055000000, 128611, 35900000, -20000000,
+		"P0PPPP", "`q:\x1c" "5\x1fWO/!!!}" },
+	/* 45 00.00 N 45 00.00 E, speed clamped, course 0 */
+	{ 450000000, 450000000, 1000000, 0, 0,
+		"T5PP00", "`IX\x1ckl\x1cO/\"3r}" },
+};
+
+/* position in 1e-7 deg and speed / course / altitude as decoded by a receiver */
+typedef struct {
+	double lat, lon;
+	int speed, course, alt;
+} mice_decoded;
+
+static int mice_digit(char c, int *flag) {
+	*flag = (c >= 'P');
+	return *flag ? c - 'P' : c - '0';
+}
+
+static mice_decoded mice_decode(const char *dst, const char *info) {
+	mice_decoded d;
+	int digit[MICE_DST_LEN], flag[MICE_DST_LEN];
+	int i, deg, min, sp, dc;
+
+	for (i = 0; i < MICE_DST_LEN; i++) {
+		digit[i] = mice_digit(dst[i], &flag[i]);
+	}
+	d.lat = digit[0] * 10 + digit[1]
+			+ (digit[2] * 1000 + digit[3] * 100 + digit[4] * 10 + digit[5]) / 6000.0;
+	if (!flag[3]) {
+		d.lat = -d.lat;
+	}
+
+	deg = info[1] - 28;
+	if (flag[4]) {
+		deg += 100;
+	}
+	if (deg >= 180 && deg <= 189) {
+		deg -= 80;
+	} else if (deg >= 190 && deg <= 199) {
+		deg -= 190;
+	}
+	min = info[2] - 28;
+	if (min >= 60) {
+		min -= 60;
+	}
+	d.lon = deg + (min * 100 + info[3] - 28) / 6000.0;
+	if (flag[5]) {
+		d.lon = -d.lon;
+	}
+
+	sp = (info[4] - 28) * 10;
+	dc = info[5] - 28;
+	d.speed = sp + dc / 10;
+	if (d.speed >= 800) {
+		d.speed -= 800;
+	}
+	d.course = (dc % 10) * 100 + info[6] - 28;
+	if (d.course >= 400) {
+		d.course -= 400;
+	}
+	d.alt = (info[9] - 33) * 91 * 91 + (info[10] - 33) * 91 + (info[11] - 33) - 10000;
+	return d;
+}
+
+static void test_vectors(void) {
+	char dst[MICE_DST_LEN + 1], info[MICE_INFO_LEN];
+	GNSS_Fix fix;
+	uint8_t i, len;
+
+	for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+		memset(&fix, 0, sizeof(fix));
+		fix.lat = vectors[i].lat;
+		fix.lon = vectors[i].lon;
+		fix.gSpeed = vectors[i].gSpeed;
+		fix.headMot = vectors[i].headMot;
+		fix.hMSL = vectors[i].hMSL;
+		len = mice_encode(&fix, dst, info);
+		CHECK(len == MICE_INFO_LEN, "vector %u: length %u", i, len);
+		CHECK(strcmp(dst, vectors[i].dst) == 0, "vector %u: destination %s, expected %s",
+				i, dst, vectors[i].dst);
+		CHECK(memcmp(info, vectors[i].info, MICE_INFO_LEN) == 0, "vector %u: info field", i);
+	}
+}
+
+static void test_round_trip(void) {
+	char dst[MICE_DST_LEN + 1], info[MICE_INFO_LEN];
+	GNSS_Fix fix;
+	mice_decoded d;
+	double lat, lon;
+	int speed, course, alt;
+	uint16_t i;
+
+	srand(4);
+	memset(&fix, 0, sizeof(fix));
+	for (i = 0; i < 20000; i++) {
+		fix.lat = (int32_t)(((uint32_t)rand() << 1) % 1800000000UL) - 899999999L;
+		fix.lon = (int32_t)(((uint32_t)rand() << 1) % 3600000000UL - 1799999999UL);
+		fix.gSpeed = rand() % 420000;
+		fix.headMot = rand() % 36000000;
+		fix.hMSL = rand() % 50000000 - 1000000;
+		mice_encode(&fix, dst, info);
+		d = mice_decode(dst, info);
+
+		/* truncated to 1/100 minute, knots and degrees, altitude to the meter */
+		lat = fix.lat / 1e7;
+		lon = fix.lon / 1e7;
+		speed = fix.gSpeed / 514.444;
+		course = fix.headMot / 100000;
+		alt = fix.hMSL / 1000;
+		CHECK(fabs(d.lat - lat) < 1 / 6000.0, "lat %ld: %.6f", (long)fix.lat, d.lat);
+		CHECK(fabs(d.lon - lon) < 1 / 6000.0, "lon %ld: %.6f", (long)fix.lon, d.lon);
+		CHECK(abs(d.speed - (speed > 799 ? 799 : speed)) <= 1, "speed %ld mm/s: %d kn",
+				(long)fix.gSpeed, d.speed);
+		CHECK(d.course == course, "course %ld: %d", (long)fix.headMot, d.course);
+		CHECK(d.alt == alt, "altitude %ld mm: %d m", (long)fix.hMSL, d.alt);
+	}
+}
+
+/* frame bytes, and bits on air with flags, stuffing and FCS, of both formats */
+static void test_airtime(void) {
+	GNSS_StateHandle gnss;
+	uint32_t bits_c = 0, bits_m = 0;
+	uint16_t bytes_c, bytes_m, i;
+
+	srand(4);
+	memset(&test_fix, 0, sizeof(test_fix));
+	for (i = 0; i < 1000; i++) {
+		test_fix.lat = (int32_t)(((uint32_t)rand() << 1) % 1800000000UL) - 899999999L;
+		test_fix.lon = (int32_t)(((uint32_t)rand() << 1) % 3600000000UL - 1799999999UL);
+		test_fix.gSpeed = rand() % 420000;
+		test_fix.headMot = rand() % 36000000;
+		test_fix.hMSL = rand() % 50000000;
+		aprs_prepare_buffer(&gnss, 0);
+		bits_c += aprs_stream_bits;
+		CHECK(aprs_prepare_mice(&gnss) == 0, "Mic-E frame %u not prepared", i);
+		bits_m += aprs_stream_bits;
+	}
+	bytes_c = aprs_header_len + APRS_BUF_LEN + 2;
+	bytes_m = aprs_header_len + MICE_INFO_LEN + 2;
+	CHECK(bytes_m < bytes_c && bits_m < bits_c, "Mic-E is not shorter");
+	printf("mice: %u bytes per frame, compressed %u; %.1f bits on air, compressed %.1f;"
+			" %.0f ms at %u baud, compressed %.0f ms, %.1f %% saved\n",
+			bytes_m, bytes_c, bits_m / (double)i, bits_c / (double)i,
+			1000.0 * bits_m / i / APRS_BAUD, APRS_BAUD, 1000.0 * bits_c / i / APRS_BAUD,
+			100.0 * (bits_c - bits_m) / bits_c);
+}
+
+int main(void) {
+	test_vectors();
+	test_round_trip();
+	test_airtime();
+	return TEST_DONE("mice");
+}
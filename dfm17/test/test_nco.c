@@ -0,0 +1,210 @@
+/**
+  ******************************************************************************
+  * @file    test_nco.c
+  * @brief   Host test of the AFSK tone and bit clock NCOs
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  * Runs processAprsTick from tim.c for simulated seconds of TIM15 updates and
+  * counts tone edges and bit clock ticks, then switches between mark and space
+  * on every bit clock tick and checks that no edge interval is cut short. The
+  * step constants of both engines are checked against their nominal frequency.
+  * The measured mark and space frequency error and the bit clock drift over a
+  * frame of APRS_STREAM_BITS bits are reported.
+  ******************************************************************************
+  */
+
+#include <math.h>
+#include <stdlib.h>
+#include "tim.h"
+#include "aprs.h"
+#include "afsk.h"
+#include "test.h"
+
+volatile uint16_t aprs_bit;
+volatile uint16_t aprs_tick;
+volatile uint16_t aprs_baud_tick;
+
+/* tim.c is linked whole, its HAL calls never run here */
+void Error_Handler(void) {
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim) { return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *htim) { return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim) { return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef *htim) { return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *htim,
+		TIM_ClockConfigTypeDef *sClockSourceConfig) { return HAL_OK; }
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim,
+		TIM_MasterConfigTypeDef *sMasterConfig) { return HAL_OK; }
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma) { return HAL_OK; }
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma) { return HAL_OK; }
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {
+}
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+}
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+}
+
+/* TIM15 updates per second */
+#define FS		((double)APRS_TICK_CLK_HZ / APRS_TICK_DIV)
+#define SAMPLES	((uint32_t)FS)
+
+static double check_step(const char *what, uint32_t step, double fs, double hz) {
+	double f = step * fs / 4294967296.0;
+
+	CHECK(fabs(f - hz) < 0.001, "%s: %.6f Hz, nominal %.0f Hz", what, f, hz);
+	return f - hz;
+}
+
+/* tone frequency from the first to the last edge over ten seconds */
+static double measure_tone(uint16_t bit) {
+	uint32_t n, first = 0, last = 0, edges = 0;
+
+	aprs_bit = bit;
+	aprs_tick = 0;
+	for (n = 1; n <= 10 * SAMPLES; n++) {
+		processAprsTick();
+		if (aprs_tick) {
+			aprs_tick = 0;
+			if (!edges++) {
+				first = n;
+			}
+			last = n;
+		}
+	}
+	/* two edges per period */
+	return (edges - 1) / 2.0 / ((last - first) / FS);
+}
+
+/* samples from one bit clock tick to the APRS_STREAM_BITS-th after it,
+ * against the ideal APRS_STREAM_BITS bit periods */
+static double measure_drift(void) {
+	uint32_t n = 0, first = 0, bits = 0;
+
+	aprs_baud_tick = 0;
+	while (bits <= APRS_STREAM_BITS) {
+		processAprsTick();
+		n++;
+		if (aprs_baud_tick) {
+			aprs_baud_tick = 0;
+			if (!bits++) {
+				first = n;
+			}
+		}
+	}
+	return (n - first) - (double)APRS_STREAM_BITS * FS / APRS_BAUD;
+}
+
+static void test_report(void) {
+	double mark, space, drift, sine_mark, sine_space, sine_baud;
+	double fs_sine = (double)APRS_TICK_CLK_HZ / AFSK_SINE_TICK_DIV;
+
+	mark = measure_tone(APRS_MARK) - APRS_MARK_HZ;
+	space = measure_tone(APRS_SPACE) - APRS_SPACE_HZ;
+	drift = measure_drift();
+	sine_mark = check_step("sine mark", AFSK_SINE_MARK_STEP, fs_sine, APRS_MARK_HZ);
+	sine_space = check_step("sine space", AFSK_SINE_SPACE_STEP, fs_sine, APRS_SPACE_HZ);
+	sine_baud = check_step("sine baud", AFSK_SINE_BAUD_STEP, fs_sine, APRS_BAUD);
+
+	/* the sample grid alone accounts for one sample */
+	CHECK(fabs(mark) < 0.05 && fabs(space) < 0.05, "tone error %.3f / %.3f Hz", mark, space);
+	CHECK(fabs(drift) <= 1.0, "bit clock drift %.2f samples", drift);
+
+	printf("nco: mark %+.4f Hz, space %+.4f Hz, bit clock %+.2f us over a %u bit frame"
+			" (%+.4f bit)\n", mark, space, drift / FS * 1e6, APRS_STREAM_BITS,
+			drift / FS * APRS_BAUD);
+	printf("nco sine: mark %+.6f Hz, space %+.6f Hz, bit clock %+.3f us over a %u bit frame\n",
+			sine_mark, sine_space, sine_baud / APRS_BAUD * APRS_STREAM_BITS / APRS_BAUD * -1e6,
+			APRS_STREAM_BITS);
+}
+
+/* tone edges and bit clock ticks over one second at a fixed tone */
+static void test_rate(uint16_t bit, uint32_t hz) {
+	uint32_t n, edges = 0, bauds = 0;
+
+	aprs_bit = bit;
+	for (n = 0; n < SAMPLES; n++) {
+		processAprsTick();
+		if (aprs_tick) {
+			aprs_tick = 0;
+			edges++;
+		}
+		if (aprs_baud_tick) {
+			aprs_baud_tick = 0;
+			bauds++;
+		}
+	}
+	CHECK(abs((int)edges - (int)(2 * hz)) <= 1, "%u Hz: %u edges per second", hz, edges);
+	CHECK(abs((int)bauds - APRS_BAUD) <= 1, "%u Hz: %u bit clock ticks per second", hz, bauds);
+}
+
+/* random bits: every edge interval lies between half a space and half a mark period */
+static void test_continuity(void) {
+	uint32_t n, last = 0, interval;
+	uint32_t shortest = SAMPLES, longest = 0;
+	uint8_t first = 1;
+
+	srand(3);
+	aprs_tick = 0;
+	aprs_baud_tick = 0;
+	for (n = 1; n < 10 * SAMPLES; n++) {
+		processAprsTick();
+		if (aprs_baud_tick) {
+			aprs_baud_tick = 0;
+			aprs_bit = rand() & 0x01;
+		}
+		if (aprs_tick) {
+			aprs_tick = 0;
+			interval = n - last;
+			last = n;
+			if (first) {
+				/* the phase carries over from test_rate */
+				first = 0;
+				continue;
+			}
+			if (interval < shortest) {
+				shortest = interval;
+			}
+			if (interval > longest) {
+				longest = interval;
+			}
+		}
+	}
+	CHECK(shortest >= (uint32_t)(FS / (2 * APRS_SPACE_HZ)), "shortest edge interval %u samples", shortest);
+	CHECK(longest <= (uint32_t)(FS / (2 * APRS_MARK_HZ)) + 1, "longest edge interval %u samples", longest);
+}
+
+int main(void) {
+	double fs_sine = (double)APRS_TICK_CLK_HZ / AFSK_SINE_TICK_DIV;
+
+	check_step("mark", APRS_MARK_STEP, FS, APRS_MARK_HZ);
+	check_step("space", APRS_SPACE_STEP, FS, APRS_SPACE_HZ);
+	check_step("baud", APRS_BAUD_STEP, FS, APRS_BAUD);
+	check_step("sine mark", AFSK_SINE_MARK_STEP, fs_sine, APRS_MARK_HZ);
+	check_step("sine space", AFSK_SINE_SPACE_STEP, fs_sine, APRS_SPACE_HZ);
+	check_step("sine baud", AFSK_SINE_BAUD_STEP, fs_sine, APRS_BAUD);
+
+	test_rate(APRS_MARK, APRS_MARK_HZ);
+	test_rate(APRS_SPACE, APRS_SPACE_HZ);
+	test_continuity();
+	test_report();
+	return TEST_DONE("nco");
+}
@@ -0,0 +1,502 @@
+/**
+  ******************************************************************************
+  * @file    test_si4063.c
+  * @brief   Host test of the Si4063 driver against a model of the radio
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 Derek Rowland <gx1400@gmail.com>
+  * All rights reserved.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ******************************************************************************
+  * The model implements si4063_bus.h in place of si4063_bus.c: SPI
+  * transactions framed by nSEL, the CTS protocol (READ_CMD_BUF and the GPIO2
+  * pin), a busy time per command, SDN, properties, the device state and a
+  * timeline of MODEM_FREQ_OFFSET while transmitting. Time is simulated in
+  * core clock cycles. A command sent while the model is not clear to send,
+  * shut down or not powered up is counted as a protocol error.
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "si4063.h"
+#include "si4063_cfg.h"
+#include "si4063_bus.h"
+#include "test.h"
+
+#define CYCLES_US		16
+#define SPI_BYTE		(1 * CYCLES_US)		/* 8 bit at 8 MHz */
+#define TIMELINE_LEN	64
+
+uint32_t SystemCoreClock = CYCLES_US * 1000000;
+
+static struct {
+	uint32_t now;
+	uint32_t busy_until;
+	uint32_t tx_at;			/* START_TX: the carrier is valid from here */
+	uint8_t hang;			/* never clear to send again */
+	uint8_t hang_after;		/* hang once this command has run, 0: never */
+	uint8_t shutdown;
+	uint8_t powered;		/* POWER_UP done */
+	uint8_t state;
+	uint8_t selected;
+	uint8_t reading;		/* READ_CMD_BUF transaction */
+	uint8_t cts_read;
+	uint8_t cmd[32];
+	uint8_t len;
+	uint8_t resp[16];
+	uint8_t resp_pos;
+	uint8_t prop[256][256];
+	uint8_t gpio[7];
+	uint32_t cmds[256];
+	uint32_t polls;			/* READ_CMD_BUF transactions */
+	uint32_t errors;
+	uint32_t t[TIMELINE_LEN];
+	uint16_t offset[TIMELINE_LEN];
+	uint8_t timeline;
+} si = { .shutdown = 1 };
+
+static uint8_t si_ready(void) {
+	return !si.shutdown && !si.hang && (int32_t)(si.now - si.busy_until) >= 0;
+}
+
+static void si_error(const char *what) {
+	si.errors++;
+	printf("model: %s, command %02X\n", what, si.cmd[0]);
+}
+
+static void si_execute(void) {
+	uint8_t group = si.cmd[1], n = si.cmd[2], first = si.cmd[3], i;
+	uint32_t busy_us = 5;
+
+	if (si.shutdown) {
+		si_error("command in shutdown");
+		return;
+	}
+	if (!si_ready()) {
+		si_error("command while not clear to send");
+		return;
+	}
+	if (!si.powered && si.cmd[0] != CMD_POWER_UP && si.cmd[0] != CMD_PART_INFO
+			&& si.cmd[0] != CMD_NOP) {
+		si_error("command before POWER_UP");
+		return;
+	}
+	si.cmds[si.cmd[0]]++;
+	memset(si.resp, 0, sizeof(si.resp));
+
+	switch (si.cmd[0]) {
+	case CMD_NOP:
+		break;
+	case CMD_PART_INFO:
+		si.resp[0] = 0x11;
+		si.resp[1] = 0x40;
+		si.resp[2] = 0x63;
+		break;
+	case CMD_POWER_UP:
+		si.powered = 1;
+		si.state = STATE_SPI_ACTIVE;
+		busy_us = 6000;
+		break;
+	case CMD_SET_PROPERTY:
+		if (si.len != 4 + n) {
+			si_error("SET_PROPERTY length");
+			return;
+		}
+		for (i = 0; i < n; i++) {
+			si.prop[group][(uint8_t)(first + i)] = si.cmd[4 + i];
+		}
+		if (group == PROP_MODEM && first <= MODEM_FREQ_OFFSET + 1
+				&& first + n > MODEM_FREQ_OFFSET && si.state == STATE_TX
+				&& si.timeline < TIMELINE_LEN) {
+			si.t[si.timeline] = si.now;
+			si.offset[si.timeline++] = si.prop[PROP_MODEM][MODEM_FREQ_OFFSET] << 8
+					| si.prop[PROP_MODEM][MODEM_FREQ_OFFSET + 1];
+		}
+		break;
+	case CMD_GET_PROPERTY:
+		for (i = 0; i < n && i < sizeof(si.resp); i++) {
+			si.resp[i] = si.prop[group][(uint8_t)(first + i)];
+		}
+		break;
+	case CMD_GPIO_PIN_CFG:
+		memcpy(si.gpio, &si.cmd[1], sizeof(si.gpio));
+		busy_us = 10;
+		break;
+	case CMD_START_TX:
+		si.state = STATE_TX_TUNE;
+		si.tx_at = si.now + 100 * CYCLES_US;
+		busy_us = 20;
+		break;
+	case CMD_CHANGE_STATE:
+		si.state = si.cmd[1];
+		busy_us = 50;
+		break;
+	case CMD_REQUEST_DEVICE_STATE:
+		if (si.state == STATE_TX_TUNE && si.tx_at && (int32_t)(si.now - si.tx_at) >= 0) {
+			si.state = STATE_TX;
+			si.tx_at = 0;
+		}
+		si.resp[0] = si.state;
+		break;
+	default:
+		si_error("unknown command");
+		return;
+	}
+	si.busy_until = si.now + busy_us * CYCLES_US;
+	if (si.hang_after && si.hang_after == si.cmd[0]) {
+		si.hang = 1;
+		si.hang_after = 0;
+	}
+}
+
+void si4060_bus_select(void) {
+	if (si.selected) {
+		si_error("select while selected");
+	}
+	si.selected = 1;
+	si.reading = 0;
+	si.len = 0;
+}
+
+uint8_t si4060_bus_try_select(void) {
+	if (si.selected) {
+		return 0;
+	}
+	si4060_bus_select();
+	return 1;
+}
+
+void si4060_bus_deselect(void) {
+	si.now += 2;
+	if (si.selected && !si.reading && si.len) {
+		si_execute();
+	}
+	si.selected = 0;
+	si.reading = 0;
+}
+
+void si4060_bus_write(uint8_t data) {
+	si.now += SPI_BYTE;
+	if (!si.selected) {
+		si_error("write while not selected");
+		return;
+	}
+	if (si.len == 0 && data == CMD_READ_CMD_BUF) {
+		si.reading = 1;
+		si.cts_read = 0;
+		si.resp_pos = 0;
+		si.polls++;
+	}
+	if (si.len < sizeof(si.cmd)) {
+		si.cmd[si.len++] = data;
+	}
+}
+
+uint8_t si4060_bus_read(void) {
+	si.now += SPI_BYTE;
+	if (!si.selected || si.shutdown) {
+		return 0x00;
+	}
+	if (!si.reading) {
+		return 0xff;
+	}
+	if (!si.cts_read) {
+		si.cts_read = si_ready() ? 0xff : 0x00;
+		return si.cts_read;
+	}
+	if (si.cts_read != 0xff || si.resp_pos >= sizeof(si.resp)) {
+		return 0x00;
+	}
+	return si.resp[si.resp_pos++];
+}
+
+void si4060_bus_send(const uint8_t *cmd, uint8_t len) {
+	uint8_t i;
+
+	si4060_bus_select();
+	for (i = 0; i < len; i++) {
+		si4060_bus_write(cmd[i]);
+	}
+	si4060_bus_deselect();
+}
+
+void si4060_bus_wait(void) {
+}
+
+void si4060_bus_sdn(uint8_t shutdown) {
+	si.now += 1;
+	if (shutdown) {
+		si.shutdown = 1;
+		si.powered = 0;
+		si.state = 0;
+		memset(si.prop, 0, sizeof(si.prop));
+		memset(si.gpio, 0, sizeof(si.gpio));
+	} else if (si.shutdown) {
+		/* power on reset */
+		si.shutdown = 0;
+		si.busy_until = si.now + 1000 * CYCLES_US;
+	}
+}
+
+uint8_t si4060_bus_cts(void) {
+	si.now += 4;
+	return si.gpio[2] == GPIO_MODE_CTS && si_ready();
+}
+
+void si4060_bus_delay_us(uint16_t us) {
+	si.now += us * CYCLES_US;
+}
+
+uint32_t si4060_bus_cycles(void) {
+	si.now += 4;
+	return si.now;
+}
+
+/* applies the SET_PROPERTY records of a configuration stream to exp */
+static void apply_cfg(const uint8_t *cfg, uint8_t exp[256][256], uint8_t set[256][256]) {
+	uint8_t len, i;
+
+	while ((len = *cfg++) != SI_CFG_END) {
+		if (cfg[0] == CMD_SET_PROPERTY) {
+			for (i = 0; i < cfg[2]; i++) {
+				exp[cfg[1]][cfg[3] + i] = cfg[4 + i];
+				set[cfg[1]][cfg[3] + i] = 1;
+			}
+		}
+		cfg += len;
+	}
+}
+
+static uint8_t exp[256][256], set[256][256], saved[256][256];
+
+static void check_props(const char *when) {
+	uint16_t g, p;
+	uint32_t wrong = 0;
+
+	for (g = 0; g < 256; g++) {
+		for (p = 0; p < 256; p++) {
+			if (set[g][p] && si.prop[g][p] != exp[g][p]) {
+				if (!wrong++) {
+					printf("%s: property %02X/%02X is %02X, expected %02X\n",
+							when, g, p, si.prop[g][p], exp[g][p]);
+				}
+			}
+		}
+	}
+	CHECK(wrong == 0, "%s: %lu properties wrong", when, (unsigned long)wrong);
+}
+
+static void test_bring_up(void) {
+	uint32_t start;
+
+	/* the sequence of initRadio */
+	si4060_wakeup();
+	si4060_reset();
+	CHECK(si4060_part_info() == 0x4063, "PART_INFO");
+	start = si.now;
+	CHECK(si4060_replay(si4060_cfg_setup) == SI_OK, "setup stream");
+	CHECK(si4060_replay(si4060_cfg_aprs_dfm17) == SI_OK, "aprs stream");
+	printf("radio config: %lu commands, %lu CTS polls over SPI, %lu us\n",
+			(unsigned long)(si.cmds[CMD_POWER_UP] + si.cmds[CMD_GPIO_PIN_CFG]
+					+ si.cmds[CMD_SET_PROPERTY]),
+			(unsigned long)si.polls, (unsigned long)((si.now - start) / CYCLES_US));
+
+	apply_cfg(si4060_cfg_setup, exp, set);
+	apply_cfg(si4060_cfg_aprs_dfm17, exp, set);
+	check_props("bring up");
+	CHECK(si.powered, "POWER_UP was not sent");
+	CHECK(si.gpio[2] == GPIO_MODE_CTS, "GPIO2 is %02X", si.gpio[2]);
+	CHECK(si.errors == 0, "%lu protocol errors", (unsigned long)si.errors);
+}
+
+static void test_cts_pin(void) {
+	uint32_t polls = si.polls;
+	uint8_t vals[3] = { 1, 2, 3 };
+
+	/* GPIO2 signals CTS now, no command should poll READ_CMD_BUF */
+	si4060_set_properties(PROP_PKT, 0x00, vals, sizeof(vals));
+	si4060_nop();
+	CHECK(si.polls == polls, "%lu READ_CMD_BUF polls with the CTS pin",
+			(unsigned long)(si.polls - polls));
+	CHECK(si.prop[PROP_PKT][2] == 3, "PKT property");
+	CHECK(si.errors == 0, "%lu protocol errors", (unsigned long)si.errors);
+}
+
+static void test_shadow(void) {
+	uint32_t props, gpios;
+	uint8_t vals[20], i;
+
+	si4060_setup(MOD_TYPE_2GFSK);
+	si4060_set_aprs_params_TESTING();
+	props = si.cmds[CMD_SET_PROPERTY];
+	gpios = si.cmds[CMD_GPIO_PIN_CFG];
+
+	/* the radio holds all of it, nothing is sent again */
+	si4060_setup(MOD_TYPE_2GFSK);
+	si4060_set_aprs_params_TESTING();
+	CHECK(si.cmds[CMD_SET_PROPERTY] == props, "%lu SET_PROPERTY sent again",
+			(unsigned long)(si.cmds[CMD_SET_PROPERTY] - props));
+	CHECK(si.cmds[CMD_GPIO_PIN_CFG] == gpios, "GPIO_PIN_CFG sent again");
+
+	/* a changed value inside a run goes out as one trimmed command */
+	si4060_set_freq_dev((uint16_t)(2*FDEV_APRS_DFM), 0x0123);
+	CHECK(si.cmds[CMD_SET_PROPERTY] == props + 1, "FREQ_DEV/OFFSET: %lu commands",
+			(unsigned long)(si.cmds[CMD_SET_PROPERTY] - props));
+	CHECK(si.len == 6 && si.cmd[3] == MODEM_FREQ_OFFSET, "sent %u bytes from %02X",
+			si.len, si.cmd[3]);
+	CHECK(si.prop[PROP_MODEM][MODEM_FREQ_OFFSET] == 0x01
+			&& si.prop[PROP_MODEM][MODEM_FREQ_OFFSET + 1] == 0x23, "FREQ_OFFSET");
+	si4060_set_freq_dev((uint16_t)(2*FDEV_APRS_DFM), 0);
+
+	/* long runs are split in SI_MAX_PROPS chunks */
+	props = si.cmds[CMD_SET_PROPERTY];
+	for (i = 0; i < sizeof(vals); i++) {
+		vals[i] = 0x80 + i;
+	}
+	CHECK(si4060_set_properties(PROP_PKT, 0x10, vals, sizeof(vals)) == SI_OK, "PKT run");
+	CHECK(si.cmds[CMD_SET_PROPERTY] - props == (sizeof(vals) + SI_MAX_PROPS - 1) / SI_MAX_PROPS,
+			"%lu commands for %u properties",
+			(unsigned long)(si.cmds[CMD_SET_PROPERTY] - props), (unsigned)sizeof(vals));
+	for (i = 0; i < sizeof(vals); i++) {
+		CHECK(si.prop[PROP_PKT][0x10 + i] == vals[i], "PKT %02X", 0x10 + i);
+	}
+	CHECK(si.errors == 0, "%lu protocol errors", (unsigned long)si.errors);
+}
+
+static void test_power_cycle(void) {
+	uint8_t gpio[sizeof(si.gpio)];
+	uint32_t gpios;
+
+	memcpy(saved, si.prop, sizeof(saved));
+	memcpy(gpio, si.gpio, sizeof(gpio));
+	CHECK(si4060_set_power(SI_PWR_SHUTDOWN) == SI_OK, "shutdown");
+	CHECK(si.shutdown, "SDN is low");
+	CHECK(si4060_set_power(SI_PWR_TX_TUNE) == SI_OK, "wake up");
+	CHECK(!si.shutdown && si.powered && si.state == STATE_TX_TUNE, "state %u", si.state);
+	CHECK(memcmp(gpio, si.gpio, sizeof(gpio)) == 0, "GPIO_PIN_CFG not restored");
+	gpios = si.cmds[CMD_GPIO_PIN_CFG];
+	memcpy(exp, saved, sizeof(exp));
+	memset(set, 0, sizeof(set));
+	memset(set[PROP_GLOBAL], 1, 4);
+	memset(set[PROP_MODEM], 1, MODEM_TX_FILTER_COEFF_0 + 1);
+	memset(set[PROP_FREQ_CONTROL], 1, FREQ_CONTROL_W_SIZE + 1);
+	set[PROP_PREAMBLE][PREAMBLE_TX_LENGTH] = 1;
+	set[PROP_SYNC][SYNC_CONFIG] = 1;
+	set[PROP_PA][PA_BIAS_CLKDUTY] = 1;
+	check_props("restore");
+	CHECK(si.errors == 0, "%lu protocol errors", (unsigned long)si.errors);
+
+	/* the radio stops answering right after POWER_UP: nothing is restored,
+	 * and what was not restored is written again by the next setters */
+	si4060_set_power(SI_PWR_SHUTDOWN);
+	si.hang_after = CMD_POWER_UP;
+	CHECK(si4060_set_power(SI_PWR_TX_TUNE) == SI_ERR_CTS_TIMEOUT, "restore without CTS");
+	CHECK(si.cmds[CMD_GPIO_PIN_CFG] == gpios, "GPIO_PIN_CFG sent without CTS");
+	CHECK(si.errors == 0, "%lu protocol errors", (unsigned long)si.errors);
+	si.hang = 0;
+	si4060_setup(MOD_TYPE_2GFSK);
+	si4060_set_aprs_params_TESTING();
+	CHECK(memcmp(gpio, si.gpio, sizeof(gpio)) == 0, "GPIO_PIN_CFG not written again");
+	memset(set[PROP_FREQ_CONTROL], 0, FREQ_CONTROL_W_SIZE + 1);
+	check_props("setup after failed restore");
+	CHECK(si.errors == 0, "%lu protocol errors", (unsigned long)si.errors);
+	si4060_set_freq_control(saved[PROP_FREQ_CONTROL][FREQ_CONTROL_INTE],
+			(uint32_t)saved[PROP_FREQ_CONTROL][FREQ_CONTROL_FRAC] << 16
+			| saved[PROP_FREQ_CONTROL][FREQ_CONTROL_FRAC + 1] << 8
+			| saved[PROP_FREQ_CONTROL][FREQ_CONTROL_FRAC + 2]);
+	CHECK(si4060_set_power(SI_PWR_TX_TUNE) == SI_OK, "TX_TUNE");
+}
+
+static void test_tx_timeline(void) {
+	static const uint16_t offsets[] = { 100, 0xff00, 0, 0x1234, 7, 7 };
+	uint8_t i;
+
+	si4060_start_tx(0);
+	CHECK(si4060_wait_state(STATE_TX, SI_STATE_TIMEOUT_US) == SI_OK, "no carrier");
+	CHECK(si.state == STATE_TX, "state %u", si.state);
+
+	/* the AFSK sample tick, one write per sample */
+	for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+		CHECK(si4060_set_offset(offsets[i]) == SI_OK, "offset %u", i);
+		si4060_bus_delay_us(75);
+	}
+	CHECK(si.timeline == sizeof(offsets) / sizeof(offsets[0]), "%u timeline entries",
+			si.timeline);
+	for (i = 1; i < si.timeline; i++) {
+		CHECK(si.offset[i] == offsets[i], "offset %u is %04X", i, si.offset[i]);
+		CHECK(si.t[i] - si.t[i - 1] >= 75 * CYCLES_US, "offset %u after %lu cycles", i,
+				(unsigned long)(si.t[i] - si.t[i - 1]));
+	}
+
+	/* with the bus taken the sample is dropped, not sent into a transfer */
+	si4060_bus_select();
+	CHECK(si4060_set_offset(0x4444) == SI_ERR_BUSY, "offset on a busy bus");
+	si4060_bus_deselect();
+	CHECK(si.prop[PROP_MODEM][MODEM_FREQ_OFFSET] != 0x44, "busy offset was sent");
+
+	si4060_stop_tx();
+	CHECK(si.state == STATE_SLEEP, "state %u after stop", si.state);
+	CHECK(si.errors == 0, "%lu protocol errors", (unsigned long)si.errors);
+}
+
+static void test_timeout(void) {
+	si4060_cts_stat *stat;
+	uint16_t timeouts;
+	uint32_t start;
+	uint8_t val = 5;
+
+	si4060_set_property_8(PROP_PREAMBLE, PREAMBLE_TX_LENGTH, 0);
+	stat = si4060_get_cts_stats(si.cmd[0]);
+	timeouts = stat ? stat->timeouts : 0;
+
+	si.hang = 1;
+	start = si.now;
+	CHECK(si4060_set_properties(PROP_PREAMBLE, PREAMBLE_TX_LENGTH, &val, 1)
+			== SI_ERR_CTS_TIMEOUT, "no timeout");
+	CHECK(si.now - start >= SI_CTS_TIMEOUT_US * CYCLES_US, "gave up after %lu us",
+			(unsigned long)((si.now - start) / CYCLES_US));
+	CHECK(si.now - start < 2 * SI_CTS_TIMEOUT_US * CYCLES_US, "waited %lu us",
+			(unsigned long)((si.now - start) / CYCLES_US));
+	CHECK(si.prop[PROP_PREAMBLE][PREAMBLE_TX_LENGTH] == 0, "sent without CTS");
+	CHECK(stat && stat->timeouts == timeouts + 1, "timeout not counted");
+	si.hang = 0;
+
+	/* the value was not taken, so it has to go out again */
+	CHECK(si4060_set_properties(PROP_PREAMBLE, PREAMBLE_TX_LENGTH, &val, 1) == SI_OK,
+			"retry");
+	CHECK(si.prop[PROP_PREAMBLE][PREAMBLE_TX_LENGTH] == val, "not resent after timeout");
+
+	/* a lost replay command is dropped from the shadow the same way */
+	si.hang = 1;
+	CHECK(si4060_replay(si4060_cfg_2m_rtty) == SI_ERR_CTS_TIMEOUT, "replay timeout");
+	si.hang = 0;
+	CHECK(si4060_replay(si4060_cfg_2m_rtty) == SI_OK, "replay");
+	memset(set, 0, sizeof(set));
+	apply_cfg(si4060_cfg_2m_rtty, exp, set);
+	check_props("replay after timeout");
+	CHECK(si.errors == 0, "%lu protocol errors", (unsigned long)si.errors);
+}
+
+int main(void) {
+	test_bring_up();
+	test_cts_pin();
+	test_shadow();
+	test_power_cycle();
+	test_tx_timeline();
+	test_timeout();
+	return TEST_DONE("si4063");
+}